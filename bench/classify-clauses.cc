@@ -0,0 +1,90 @@
+// vim:filetype=cpp:textwidth=120:shiftwidth=2:softtabstop=2:expandtab
+// Copyright 2017 Christoph Schwering
+// Licensed under the MIT license. See LICENSE file in the project root.
+//
+// Microbenchmark of clause classification: tests random clauses with nested
+// and non-ground terms for ground(), primitive(), and quasiprimitive() and
+// reports how many clauses are classified per second.
+
+#include <chrono>
+#include <cstdlib>
+
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <limbo/clause.h>
+#include <limbo/literal.h>
+#include <limbo/term.h>
+
+using namespace limbo;
+
+int main(int argc, char *argv[]) {
+  if (argc != 1 && argc != 3) {
+    std::cout << "Usage: " << argv[0] << " [<n-clauses> <n-rounds>]" << std::endl;
+    return 2;
+  }
+  const size_t n_clauses = argc == 3 ? std::atoi(argv[1]) : 20000;
+  const size_t n_rounds = argc == 3 ? std::atoi(argv[2]) : 100;
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort sort = sf.CreateSort();
+  unsigned int seed = 0;
+  auto rand = [&seed](size_t n) { seed = seed * 1103515245 + 12345; return (seed / 65536) % n; };
+
+  std::vector<Term> names;
+  std::vector<Term> vars;
+  std::vector<Symbol> funcs;
+  for (int i = 0; i < 10; ++i) {
+    names.push_back(tf.CreateTerm(sf.CreateName(sort)));
+  }
+  for (int i = 0; i < 3; ++i) {
+    vars.push_back(tf.CreateTerm(sf.CreateVariable(sort)));
+  }
+  for (Symbol::Arity i = 0; i <= 3; ++i) {
+    funcs.push_back(sf.CreateFunction(sort, i));
+  }
+  // Mostly names and variables as arguments, so that all three properties
+  // occur, but sometimes nested functions up to the given depth.
+  std::function<Term(int)> term = [&](int depth) {
+    const Symbol f = funcs[rand(funcs.size())];
+    std::vector<Term> args;
+    for (Symbol::Arity i = 0; i < f.arity(); ++i) {
+      const size_t r = rand(10);
+      args.push_back(r < 6 ? names[rand(names.size())] :
+                     r < 8 || depth == 0 ? vars[rand(vars.size())] :
+                     term(depth - 1));
+    }
+    return tf.CreateTerm(f, args);
+  };
+  std::vector<Clause> clauses;
+  for (size_t i = 0; i < n_clauses; ++i) {
+    std::vector<Literal> lits;
+    const size_t n = 1 + rand(4);
+    for (size_t j = 0; j < n; ++j) {
+      const Term lhs = term(2);
+      const Term rhs = rand(4) > 0 ? names[rand(names.size())] : vars[rand(vars.size())];
+      lits.push_back(rand(2) == 0 ? Literal::Eq(lhs, rhs) : Literal::Neq(lhs, rhs));
+    }
+    clauses.push_back(Clause(lits.begin(), lits.end()));
+  }
+
+  size_t n_ground = 0;
+  size_t n_primitive = 0;
+  size_t n_quasiprimitive = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < n_rounds; ++round) {
+    for (const Clause& c : clauses) {
+      n_ground += c.ground() ? 1 : 0;
+      n_primitive += c.primitive() ? 1 : 0;
+      n_quasiprimitive += c.quasiprimitive() ? 1 : 0;
+    }
+  }
+  const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+  std::cout << "clauses: " << n_clauses << ", rounds: " << n_rounds << std::endl;
+  std::cout << "ground: " << n_ground / n_rounds << ", primitive: " << n_primitive / n_rounds
+            << ", quasiprimitive: " << n_quasiprimitive / n_rounds << std::endl;
+  std::cout << "time: " << duration.count() << " seconds, " << (n_clauses * n_rounds / duration.count() / 1e6)
+            << " million clauses per second" << std::endl;
+  return 0;
+}
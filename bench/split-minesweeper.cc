@@ -0,0 +1,54 @@
+// vim:filetype=cpp:textwidth=120:shiftwidth=2:softtabstop=2:expandtab
+// Copyright 2017 Christoph Schwering
+// Licensed under the MIT license. See LICENSE file in the project root.
+//
+// Benchmark of split throughput: plays a number of Minesweeper games with
+// consecutive seeds with the agent of examples/minesweeper and reports the
+// time spent in queries, which is dominated by splitting.
+
+#include <cstdlib>
+
+#include <iostream>
+
+#include "agent.h"
+#include "game.h"
+#include "kb.h"
+#include "timer.h"
+
+struct NullLogger {
+  void explored(Point, int) const {}
+  void flagged(Point, int) const {}
+};
+
+int main(int argc, char *argv[]) {
+  if (argc != 1 && argc != 6) {
+    std::cout << "Usage: " << argv[0] << " [<width> <height> <n-mines> <n-games> <max-k>]" << std::endl;
+    return 2;
+  }
+  const size_t width = argc == 6 ? std::atoi(argv[1]) : 30;
+  const size_t height = argc == 6 ? std::atoi(argv[2]) : 16;
+  const size_t n_mines = argc == 6 ? std::atoi(argv[3]) : 99;
+  const size_t n_games = argc == 6 ? std::atoi(argv[4]) : 10;
+  const size_t max_k = argc == 6 ? std::atoi(argv[5]) : 2;
+  size_t n_wins = 0;
+  size_t n_queries = 0;
+  Timer timer;
+  for (size_t seed = 1; seed <= n_games; ++seed) {
+    Game g(width, height, n_mines, seed);
+    KnowledgeBase kb(&g, max_k);
+    Agent<NullLogger> agent(&g, &kb);
+    do {
+      timer.start();
+      agent.Explore();
+      timer.stop();
+    } while (!g.hit_mine() && !g.all_explored());
+    n_wins += !g.hit_mine() ? 1 : 0;
+    n_queries += kb.timer().rounds();
+  }
+  std::cout << "games: " << n_games << ", wins: " << n_wins << ", size: " << width << "x" << height
+            << ", mines: " << n_mines << ", max-k: " << max_k << std::endl;
+  std::cout << "moves: " << timer.rounds() << ", queries: " << n_queries << std::endl;
+  std::cout << "time: " << timer.duration() << " seconds, " << (1000 * timer.duration() / timer.rounds())
+            << " milliseconds per move" << std::endl;
+  return 0;
+}
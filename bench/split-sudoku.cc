@@ -0,0 +1,57 @@
+// vim:filetype=cpp:textwidth=120:shiftwidth=2:softtabstop=2:expandtab
+// Copyright 2017 Christoph Schwering
+// Licensed under the MIT license. See LICENSE file in the project root.
+//
+// Benchmark of split throughput: plays the Sudokus from a file, one per line
+// as in examples/sudoku/sudokus.txt, with the agent of examples/sudoku and
+// reports the time the agent takes for its moves, which is dominated by
+// splitting.
+
+#include <cstdlib>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <limbo/internal/maybe.h>
+
+#include "agent.h"
+#include "game.h"
+#include "kb.h"
+#include "timer.h"
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <sudokus-file> [<max-k>]" << std::endl;
+    return 2;
+  }
+  std::ifstream file(argv[1]);
+  const int max_k = argc >= 3 ? std::atoi(argv[2]) : 2;
+  size_t n_games = 0;
+  size_t n_solved = 0;
+  size_t n_queries = 0;
+  Timer timer;
+  for (std::string line; std::getline(file, line); ) {
+    const std::string cfg = line.substr(0, line.find(' '));
+    if (cfg.length() != 9*9) {
+      continue;
+    }
+    Game g(cfg);
+    KnowledgeBase kb(&g, max_k);
+    KnowledgeBaseAgent agent(&g, &kb);
+    limbo::internal::Maybe<Agent::Result> r;
+    do {
+      timer.start();
+      r = agent.Explore();
+      timer.stop();
+    } while (!g.solved() && g.legal() && r);
+    ++n_games;
+    n_solved += g.solved() && g.legal() ? 1 : 0;
+    n_queries += kb.timer().rounds();
+  }
+  std::cout << "games: " << n_games << ", solved: " << n_solved << ", max-k: " << max_k << std::endl;
+  std::cout << "moves: " << timer.rounds() << ", queries: " << n_queries << std::endl;
+  std::cout << "time: " << timer.duration() << " seconds, " << (1000 * timer.duration() / timer.rounds())
+            << " milliseconds per move" << std::endl;
+  return 0;
+}
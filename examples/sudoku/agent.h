@@ -5,6 +5,7 @@
 #define EXAMPLES_SUDOKU_AGENT_H_
 
 #include <iostream>
+#include <vector>
 
 #include <limbo/internal/maybe.h>
 
@@ -29,29 +30,42 @@ class KnowledgeBaseAgent : public Agent {
  public:
   KnowledgeBaseAgent(Game* g, KnowledgeBase* kb) : g_(g), kb_(kb) {}
 
+  // The values of all cells determined by one search are kept, as they stay
+  // determined when further values are added, and returned one at a time.
   limbo::internal::Maybe<Result> Explore() override {
-    for (int k = 0; k <= kb_->max_k(); ++k) {
-      for (std::size_t x = 1; x <= 9; ++x) {
-        for (std::size_t y = 1; y <= 9; ++y) {
-          Point p(x, y);
-          if (g_->get(p) == 0) {
-            const limbo::internal::Maybe<int> r = kb_->Val(p, k);
-            if (r) {
-              const int n = r.val;
-              kb_->Add(p, n);
-              g_->set(p, n);
-              return limbo::internal::Just(Result(p, n, k));
+    if (pending_.empty()) {
+      for (int k = 0; k <= kb_->max_k() && pending_.empty(); ++k) {
+        std::vector<Point> ps;
+        for (std::size_t x = 1; x <= 9; ++x) {
+          for (std::size_t y = 1; y <= 9; ++y) {
+            Point p(x, y);
+            if (g_->get(p) == 0) {
+              ps.push_back(p);
             }
           }
         }
+        const std::vector<limbo::internal::Maybe<int>> rs = kb_->Vals(ps, k);
+        for (std::size_t i = ps.size(); i > 0; --i) {
+          if (rs[i-1]) {
+            pending_.push_back(Result(ps[i-1], rs[i-1].val, k));
+          }
+        }
+      }
+      if (pending_.empty()) {
+        return limbo::internal::Nothing;
       }
     }
-    return limbo::internal::Nothing;
+    const Result r = pending_.back();
+    pending_.pop_back();
+    kb_->Add(r.p, r.n);
+    g_->set(r.p, r.n);
+    return limbo::internal::Just(r);
   }
 
  private:
   Game* g_;
   KnowledgeBase* kb_;
+  std::vector<Result> pending_;
 };
 
 #endif  // EXAMPLES_SUDOKU_AGENT_H_
@@ -111,6 +111,30 @@ class KnowledgeBase {
     return limbo::internal::Nothing;
   }
 
+  // Like Val() for every point, but in a single search.
+  std::vector<limbo::internal::Maybe<int>> Vals(const std::vector<Point>& ps, int k) {
+    t_.start();
+    std::vector<limbo::Term> terms;
+    for (const Point p : ps) {
+      terms.push_back(val(p));
+    }
+    const std::vector<limbo::internal::Maybe<limbo::Term>> rs =
+        solver()->DeterminesAll(k, terms, limbo::Solver::kConsistencyGuarantee);
+    std::vector<limbo::internal::Maybe<int>> vals(ps.size());
+    for (std::size_t j = 0; j < ps.size(); ++j) {
+      if (rs[j]) {
+        assert(!rs[j].val.null());
+        for (std::size_t i = 1; i <= 9; ++i) {
+          if (rs[j].val == n(i)) {
+            vals[j] = limbo::internal::Just(i);
+          }
+        }
+      }
+    }
+    t_.stop();
+    return vals;
+  }
+
   const Timer& timer() const { return t_; }
   void ResetTimer() { t_.reset(); }
 
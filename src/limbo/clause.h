@@ -75,6 +75,25 @@ class Clause {
 #endif
   }
 
+  // Replaces the literals with [begin, end), which must be sorted and free of
+  // duplicates and invalid literals, so they are not minimized again. The
+  // storage is reused unless the clause grows beyond its current size.
+  template<typename ForwardIt>
+  void AssignMinimal(ForwardIt begin, ForwardIt end) {
+    const size_t old_size2 = size2();
+    size_ = std::distance(begin, end);
+    if (size2() > old_size2) {
+      lits2_ = std::unique_ptr<Literal[]>(new Literal[size2()]);
+    }
+    std::copy(begin, end, this->begin());
+    assert(std::is_sorted(this->begin(), this->end()));
+    assert(std::adjacent_find(this->begin(), this->end()) == this->end());
+    assert(!any([](Literal a) { return a.invalid(); }));
+#ifdef BLOOM
+    InitBloom();
+#endif
+  }
+
   Clause(const Clause& c) : Clause(c.size_) {
     std::memcpy(lits1_, c.lits1_, size1() * sizeof(Literal));
     if (size2() > 0) {
@@ -332,6 +351,23 @@ next:
 #endif
   }
 
+  // UnitIndex must provide a function Complementary(Literal) that determines
+  // whether a literal is complementary to any of the units in the index.
+  template<typename UnitIndex>
+  void PropagateUnits(const UnitIndex& units) {
+    assert(primitive());
+    assert(!valid());
+    for (size_t i = 0; i < size(); ++i) {
+      if (units.Complementary((*this)[i])) {
+        Nullify(i);
+      }
+    }
+    RemoveNulls();
+#ifdef BLOOM
+    InitBloom();
+#endif
+  }
+
   bool ground()         const { return all([](Literal a) { return a.ground(); }); }
   bool primitive()      const { return all([](Literal a) { return a.primitive(); }); }
   bool quasiprimitive() const { return all([](Literal a) { return a.quasiprimitive(); }); }
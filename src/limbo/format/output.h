@@ -203,7 +203,7 @@ std::ostream& operator<<(std::ostream& os, const Clause& c) {
         internal::LexicographicComparator<
             PrintSymbolComparator,
             internal::LessComparator<Symbol::Arity>,
-            internal::LexicographicContainerComparator<Term::Vector, PrintTermComparator>> comp;
+            internal::LexicographicContainerComparator<Term::Args, PrintTermComparator>> comp;
         return comp(t1.symbol(), t1.arity(), t1.args(),
                     t2.symbol(), t2.arity(), t2.args());
       }
@@ -12,10 +12,56 @@
 // The Ground() method aims to avoid unnecessary regrounding of all clauses.
 // To this end, we distinguish internally between processed and unprocessed
 // clauses. A call to Ground() only grounds the unprocessed clauses and adds
-// them to a new Setup, which inherits the other clauses from the previous
-// result of Ground(). The unprocessed clauses include those which were added
-// with AddClause(). In case new names have been added due to AddClause() or
-// PrepareForQuery(), the unprocessed clauses include all added clauses.
+// them to the Setup, which keeps the other clauses from the previous calls of
+// Ground(). The unprocessed clauses include those which were added with
+// AddClause(). In case new names have been added due to AddClause() or
+// PrepareForQuery(), the processed clauses are additionally grounded for
+// those assignments which use at least one of the new names; the other
+// assignments are in the Setup already.
+//
+// The plus names needed for the quantifiers of a query are, however, not
+// added for good. Only as many names as the query needs in addition to those
+// of the clauses are drawn from the pool of CreateName() and ReturnName().
+// They show up in Names() until the query is ended by EndQuery() or the next
+// PrepareForQuery(). The clauses grounded with these names are added
+// temporarily to a Setup::ShallowCopy of the cached Setup, so that they do
+// not trigger a regrounding and vanish again with the query.
+//
+// With set_lazy_grounding(), Ground() does not ground all clauses, but only
+// those instances which are connected to the terms of the queries passed to
+// PrepareForQuery(), where two ground clauses are connected if they mention
+// a common left-hand side; only these can interact by unit propagation or
+// splitting. To find the clauses that match a term, they are indexed by the
+// function symbols of their left-hand sides. The terms whose instances have
+// been grounded are remembered, so the grounding grows with the union of the
+// queries' neighbourhoods. It is sound, but it may miss an inconsistency of
+// clauses unrelated to the query, which is why it is meant for queries with
+// a consistency guarantee.
+//
+// Given a ThreadPool with set_thread_pool(), Ground() instantiates the
+// clauses in parallel, split by clause and by the name of its first variable.
+// Each task writes to its own buffer; the buffers are merged in the order of
+// the tasks and without duplicates before the instances are added to the
+// Setup. This requires Term::Factory to be thread-safe, which it is.
+//
+// Several Grounders may share the clauses of a common base with set_base().
+// The base's clauses are grounded only once, in the base's Setup, and each
+// Grounder on top of the base keeps only its delta in its own Setup: the
+// instances of its own clauses and those instances of the base's clauses
+// which use a name the base does not know. Ground() then returns the base's
+// Setup with this delta added to a Setup::ShallowCopy of it, so memory is
+// roughly the base plus the sum of the deltas. Only one such layer exists at
+// a time; it is replaced when another Grounder on the same base grounds, and
+// it is removed when the base itself is grounded. A layer's query clauses
+// sit on a further ShallowCopy on top, which dies with EndQuery(), so that
+// consecutive queries of the same Grounder reuse the delta.
+//
+// A private layer, see set_private_layer(), instead keeps its delta on a
+// Setup::Overlay() of the base's Setup that it owns. The base's Setup is then
+// only read, so several private layers may be grounded and queried at the
+// same time, as long as the base has been grounded before and does not
+// change meanwhile. An overlay costs a copy of the base's units and watched
+// literals, but not of its clauses.
 //
 // Sometimes names are used temporarily in queries. For that purpose, Grounder
 // offers CreateName() and ReturnName() as a layer on-top of Term::Factory and
@@ -30,10 +76,12 @@
 #include <algorithm>
 #include <list>
 #include <memory>
+#include <numeric>
 #include <queue>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include <limbo/clause.h>
 #include <limbo/formula.h>
@@ -41,8 +89,10 @@
 
 #include <limbo/internal/hash.h>
 #include <limbo/internal/ints.h>
+#include <limbo/internal/intmap.h>
 #include <limbo/internal/iter.h>
 #include <limbo/internal/maybe.h>
+#include <limbo/internal/threadpool.h>
 
 namespace limbo {
 
@@ -73,7 +123,69 @@ class Grounder {
     }
   };
 
-  typedef std::unordered_set<LiteralSet, LiteralSetHash> LiteralAssignmentSet;
+  // The sets of literals which a split may assign at once. The literals of
+  // all sets are stored in a single vector, and each set is a range thereof.
+  class LiteralAssignmentSet {
+   public:
+    class Literals {
+     public:
+      typedef const Literal* iterator;
+
+      Literals(iterator begin, iterator end) : begin_(begin), end_(end) {}
+
+      iterator begin() const { return begin_; }
+      iterator end()   const { return end_; }
+
+      size_t size() const { return end_ - begin_; }
+      bool empty() const { return begin_ == end_; }
+
+     private:
+      iterator begin_;
+      iterator end_;
+    };
+
+    class iterator {
+     public:
+      typedef std::ptrdiff_t difference_type;
+      typedef Literals value_type;
+      typedef const value_type* pointer;
+      typedef value_type reference;
+      typedef std::input_iterator_tag iterator_category;
+
+      iterator(const LiteralAssignmentSet* owner, size_t index) : owner_(owner), index_(index) {}
+
+      bool operator==(const iterator& it) const { return owner_ == it.owner_ && index_ == it.index_; }
+      bool operator!=(const iterator& it) const { return !(*this == it); }
+
+      reference operator*() const { return (*owner_)[index_]; }
+      iterator& operator++() { ++index_; return *this; }
+
+     private:
+      const LiteralAssignmentSet* owner_;
+      size_t index_;
+    };
+
+    template<typename InputIt>
+    void Add(InputIt begin, InputIt end) {
+      lits_.insert(lits_.end(), begin, end);
+      ends_.push_back(lits_.size());
+    }
+
+    Literals operator[](size_t i) const {
+      const Literal* lits = lits_.data();
+      return Literals(lits + (i == 0 ? 0 : ends_[i - 1]), lits + ends_[i]);
+    }
+
+    size_t size() const { return ends_.size(); }
+    bool empty() const { return ends_.empty(); }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end()   const { return iterator(this, ends_.size()); }
+
+   private:
+    std::vector<Literal> lits_;
+    std::vector<size_t> ends_;
+  };
 
   class SortedTermSet : public internal::IntMap<Symbol::Sort, TermSet> {
    public:
@@ -112,6 +224,14 @@ class Grounder {
       const TermSet& ts = (*this)[t.sort()];
       return ts.find(t) != ts.end();
     }
+
+    size_t n_terms() const {
+      size_t n = 0;
+      for (const TermSet& set : values()) {
+        n += set.size();
+      }
+      return n;
+    }
   };
 
   Grounder(Symbol::Factory* sf, Term::Factory* tf) : sf_(sf), tf_(tf) {}
@@ -134,6 +254,10 @@ class Grounder {
     if (c.valid()) {
       return;
     }
+    if (base_) {
+      SyncWithBase();
+    }
+    ++version_;
     names_changed_ |= AddMentionedNames(Mentioned<SortedTermSet>([](Term t) { return t.name(); }, c));
     names_changed_ |= AddPlusNames(PlusNames(c));
     AddSplitTerms(Mentioned<TermSet>([](Term t) { return t.quasiprimitive(); }, c));
@@ -141,36 +265,125 @@ class Grounder {
     unprocessed_clauses_.push_front(c);
   }
 
-  void PrepareForQuery(split_level k, const Formula& phi) {
-    assert(phi.objective());
-    names_changed_ |= AddMentionedNames(Mentioned<SortedTermSet>([](Term t) { return t.name(); }, phi));
-    names_changed_ |= AddPlusNames(PlusNames(phi));
-    if (k > 0) {
-      AddSplitTerms(Mentioned<TermSet>([](Term t) { return t.function(); }, phi));
-      AddAssignmentLiterals(Mentioned<LiteralSet>([](Literal a) { return a.lhs().function(); }, phi));
+  void PrepareForQuery(split_level k, const Formula& phi) { PrepareForQuery(k, &phi, &phi + 1); }
+
+  void PrepareForQuery(split_level k, Term lhs) { PrepareForQuery(k, &lhs, &lhs + 1); }
+
+  // Prepares for a batch of queries, given as a range of formulas, references
+  // to formulas, or terms, which are then evaluated on the same Setup. The
+  // plus names are those of the query that needs the most.
+  template<typename InputIt>
+  void PrepareForQuery(split_level k, InputIt begin, InputIt end) {
+    EndQuery();
+    if (base_) {
+      SyncWithBase();
+    }
+    PlusMap plus;
+    for (auto it = begin; it != end; ++it) {
+      names_changed_ |= AddMentionedNames(Mentioned<SortedTermSet>([](Term t) { return t.name(); }, query(*it)));
+      plus.Zip(PlusNames(query(*it)), [](size_t p1, size_t p2) { return std::max(p1, p2); });
+    }
+    AddQueryNames(plus);
+    for (auto it = begin; it != end; ++it) {
+      AddQueryTerms(k, query(*it));
     }
   }
 
-  void PrepareForQuery(split_level k, Term lhs) {
-    names_changed_ |= AddMentionedNames(Mentioned<SortedTermSet>([](Term t) { return t.name(); }, lhs));
-    names_changed_ |= AddPlusNames(PlusNames(lhs));
-    if (k > 0) {
-      AddSplitTerms(Mentioned<TermSet>([](Term t) { return t.function(); }, lhs));
+  // Discards the names and clauses that were added only for the last query.
+  void EndQuery() {
+    overlay_ = nullptr;
+    if (base_ && base_->layer_owner_ == layer_id_) {
+      base_->layer_query_ = nullptr;
+    }
+    seeds_.clear();
+    query_closed_.clear();
+    query_clauses_.clear();
+    for (const TermSet& ns : query_names_.values()) {
+      for (const Term n : ns) {
+        names_.erase(n);
+        ReturnName(n);
+      }
+    }
+    query_names_.clear();
+  }
+
+  void set_learn_nogoods(bool b) {
+    learn_nogoods_ = b;
+    if (setup_) {
+      setup_.val.set_learn_nogoods(b);
+    }
+  }
+
+  // Grounds clauses in parallel on the given pool, or sequentially if it is
+  // null. The pool is not owned by the Grounder.
+  void set_thread_pool(internal::ThreadPool* pool) { pool_ = pool; }
+
+  // Makes this Grounder a layer on top of base, see above; its clauses then
+  // include those of base, though clauses() does not list them. The base is
+  // not owned by the Grounder, must not be a layer itself, and neither of
+  // them may use lazy grounding. The base itself is not meant for queries.
+  void set_base(Grounder* base) {
+    assert(base && !base->base_ && !base->lazy_ && !lazy_);
+    EndQuery();
+    ++version_;
+    base_ = base;
+    layer_id_ = ++base->n_layers_;
+    base_clauses_ = 0;
+    base_names_ = 0;
+    setup_ = internal::Nothing;
+    unprocessed_clauses_.splice(unprocessed_clauses_.begin(), processed_clauses_);
+    SyncWithBase();
+  }
+
+  // Makes this layer private or shared, see above. The layers on the same
+  // base should either all be private or none of them.
+  void set_private_layer(bool b) {
+    assert(base_);
+    EndQuery();
+    if (base_->layer_owner_ == layer_id_) {
+      base_->ReleaseLayer();
+    }
+    private_layer_ = b;
+    private_setup_ = internal::Nothing;
+  }
+
+  void set_lazy_grounding(bool b) {
+    assert(!base_ && n_layers_ == 0);
+    if (lazy_ == b) {
+      return;
     }
+    EndQuery();
+    ++version_;
+    lazy_ = b;
+    setup_ = internal::Nothing;
+    unprocessed_clauses_.splice(unprocessed_clauses_.begin(), processed_clauses_);
+    new_names_.clear();
+    closed_.clear();
+    patterns_.clear();
   }
 
   const Setup& Ground() const { return const_cast<Grounder*>(this)->Ground(); }
 
   const Setup& Ground() {
-    if (names_changed_) {
-      // Re-ground all clauses, i.e., all clauses are considered unprocessed and all old setups are forgotten.
-      unprocessed_clauses_.splice(unprocessed_clauses_.begin(), processed_clauses_);
-      setup_ = internal::Nothing;
-      assert(processed_clauses_.empty());
+    if (base_) {
+      return GroundLayer();
     }
-    if (!unprocessed_clauses_.empty() || !setup_) {
+    ReleaseLayer();
+    if (lazy_) {
+      GroundRelevant();
+    } else if (names_changed_ || !unprocessed_clauses_.empty() || !setup_) {
+      overlay_ = nullptr;
+      for (const TermSet& ns : query_names_.values()) {
+        for (const Term n : ns) {
+          names_.erase(n);
+        }
+      }
+      if (names_changed_ && setup_) {
+        GroundNewAssignments(processed_clauses_, &new_names_, [this](const Clause& c) { setup_.val.AddClause(c); });
+      }
       if (!setup_) {
         setup_ = internal::Just(Setup());
+        setup_.val.set_learn_nogoods(learn_nogoods_);
       }
       for (const Clause& c : unprocessed_clauses_) {
         if (c.ground()) {
@@ -178,26 +391,48 @@ class Grounder {
           if (!c.valid()) {
             setup_.val.AddClause(c);
           }
-        } else {
-          const TermSet vars = Mentioned<TermSet>([](Term t) { return t.variable(); }, c);
-          for (const Assignments::Assignment& mapping : Assignments(vars, &names_)) {
-            const Clause ci = c.Substitute(mapping, tf_);
-            if (!ci.valid()) {
-              assert(ci.primitive());
-              setup_.val.AddClause(ci);
-            }
-          }
         }
       }
+      GroundNewAssignments(unprocessed_clauses_, nullptr, [this](const Clause& c) { setup_.val.AddClause(c); });
       processed_clauses_.splice(processed_clauses_.begin(), unprocessed_clauses_);
       names_changed_ = false;
+      new_names_.clear();
       setup_.val.Minimize();
+      names_.insert(query_names_);
+    }
+    const auto query_names = query_names_.values();
+    if (!overlay_ && std::any_of(query_names.begin(), query_names.end(), [](const TermSet& ns) { return !ns.empty(); })) {
+      overlay_ = std::unique_ptr<Setup::ShallowCopy>(new Setup::ShallowCopy(setup_.val.shallow_copy()));
+      if (lazy_) {
+        for (const Clause& c : query_clauses_) {
+          overlay_->AddClause(c);
+        }
+      } else {
+        GroundNewAssignments(processed_clauses_, &query_names_, [this](const Clause& c) { overlay_->AddClause(c); });
+      }
     }
     assert(bool(setup_));
     return setup_.val;
   }
 
-  const SortedTermSet& Names() const { return names_; }
+  const SortedTermSet& Names() const {
+    if (base_) {
+      const_cast<Grounder*>(this)->SyncWithBase();
+    }
+    return names_;
+  }
+
+  // Changes whenever the clauses, names, split terms, or assignment literals
+  // change, including those of the base and the clauses that lazy grounding
+  // adds to the Setup, except for the names that are added only for the
+  // current query. The results of queries hence cannot change as long as the
+  // version stays the same.
+  size_t version() const {
+    if (base_) {
+      const_cast<Grounder*>(this)->SyncWithBase();
+    }
+    return version_;
+  }
 
   Term CreateName(Symbol::Sort sort) {
     TermSet& ns = owned_names_[sort];
@@ -299,122 +534,124 @@ class Grounder {
 
   typedef internal::IntMap<Symbol::Sort, size_t> PlusMap;
 
+  // The assignments of names to a few variables. The variables are kept in a
+  // vector, each with a vector of the names of its sort, and the assignments
+  // are enumerated like an odometer, the first variable being the fastest
+  // digit. Every assignment has an index, which allows to split the
+  // assignments into Chunks, for instance, to ground them in parallel.
   class Assignments {
    public:
-    class TermRange {
-     public:
-      TermRange() = default;
-      explicit TermRange(const TermSet* terms) : terms_(terms) { Reset(); }
-
-      bool operator==(const TermRange r) const { return terms_ == r.terms_ && begin_ == r.begin_; }
-      bool operator!=(const TermRange r) const { return !(*this == r); }
-
-      TermSet::const_iterator begin() const { return begin_; }
-      TermSet::const_iterator end()   const { return terms_->end(); }
-
-      bool empty() const { return begin_ == terms_->end(); }
-
-      void Reset() { begin_ = terms_->begin(); }
-      void Next() { ++begin_; }
-
-     private:
-      const TermSet* terms_;
-      TermSet::const_iterator begin_;
-    };
-
     class Assignment {
      public:
       internal::Maybe<Term> operator()(Term x) const {
-        auto it = map_.find(x);
-        if (it != map_.end()) {
-          auto r = it->second;
-          assert(!r.empty());
-          const Term t = *r.begin();
-          return internal::Just(t);
-        } else {
-          return internal::Nothing;
+        for (size_t i = 0; i < vars_->size(); ++i) {
+          if ((*vars_)[i] == x) {
+            return internal::Just(values_[i]);
+          }
         }
+        return internal::Nothing;
       }
 
-      bool operator==(const Assignment& a) const { return map_ == a.map_; }
+      bool operator==(const Assignment& a) const { return vars_ == a.vars_ && values_ == a.values_; }
       bool operator!=(const Assignment& a) const { return !(*this == a); }
 
-      TermRange& operator[](Term t) { return map_[t]; }
-
-      std::unordered_map<Term, TermRange>::iterator begin() { return map_.begin(); }
-      std::unordered_map<Term, TermRange>::iterator end() { return map_.end(); }
+      const std::vector<Term>& vars() const { return *vars_; }
+      Term operator[](size_t i) const { return values_[i]; }
 
      private:
-      std::unordered_map<Term, TermRange> map_;
+      friend class Assignments;
+
+      explicit Assignment(const std::vector<Term>* vars) : vars_(vars), values_(vars->size()) {}
+
+      const std::vector<Term>* vars_;
+      std::vector<Term> values_;
     };
 
-    struct assignment_iterator {
+    class assignment_iterator {
+     public:
       typedef std::ptrdiff_t difference_type;
       typedef const Assignment value_type;
       typedef value_type* pointer;
       typedef value_type& reference;
       typedef std::input_iterator_tag iterator_category;
 
-      // These iterators are really heavy-weight, especially comparison is
-      // unusually expensive. To boost the usual comparison with end(), we
-      // hence reset the substitutes_ pointer to nullptr once the end is
-      // reached.
-      assignment_iterator() {}
-      assignment_iterator(const TermSet& vars, const SortedTermSet* substitutes) : substitutes_(substitutes) {
-        for (const Term var : vars) {
-          assert(var.symbol().variable());
-          TermRange r(&((*substitutes_)[var.sort()]));
-          assignment_[var] = r;
-          assert(!r.empty());
-          assert(var.sort() == r.begin()->sort());
+      assignment_iterator(const Assignments* owner, size_t index)
+          : owner_(owner), index_(index), digits_(owner->vars_.size()), assignment_(&owner->vars_) {
+        if (index_ < owner_->size_) {
+          for (size_t i = 0; i < digits_.size(); ++i) {
+            const size_t n = owner_->domains_[i].size();
+            digits_[i] = index % n;
+            index /= n;
+            assignment_.values_[i] = owner_->domains_[i][digits_[i]];
+          }
         }
-        meta_iter_ = assignment_.end();
       }
 
-      bool operator==(const assignment_iterator& it) const {
-        return substitutes_ == it.substitutes_ &&
-              (substitutes_ == nullptr || (assignment_ == it.assignment_ &&
-                                           *meta_iter_ == *it.meta_iter_));
-      }
+      bool operator==(const assignment_iterator& it) const { return owner_ == it.owner_ && index_ == it.index_; }
       bool operator!=(const assignment_iterator& it) const { return !(*this == it); }
 
       reference operator*() const { return assignment_; }
+      pointer operator->() const { return &assignment_; }
 
       assignment_iterator& operator++() {
-        for (meta_iter_ = assignment_.begin(); meta_iter_ != assignment_.end(); ++meta_iter_) {
-          TermRange& r = meta_iter_->second;
-          assert(meta_iter_->first.symbol().variable());
-          assert(!r.empty());
-          r.Next();
-          if (!r.empty()) {
+        ++index_;
+        for (size_t i = 0; i < digits_.size(); ++i) {
+          const std::vector<Term>& domain = owner_->domains_[i];
+          if (++digits_[i] == domain.size()) {
+            digits_[i] = 0;
+          }
+          assignment_.values_[i] = domain[digits_[i]];
+          if (digits_[i] != 0) {
             break;
-          } else {
-            r.Reset();
-            assert(!r.empty());
-            assert(meta_iter_->first.sort() == r.begin()->sort());
           }
         }
-        if (meta_iter_ == assignment_.end()) {
-          substitutes_ = nullptr;
-          assert(*this == assignment_iterator());
-        }
         return *this;
       }
 
      private:
-      const SortedTermSet* substitutes_ = nullptr;
+      const Assignments* owner_;
+      size_t index_;
+      std::vector<size_t> digits_;
       Assignment assignment_;
-      std::unordered_map<Term, TermRange>::iterator meta_iter_;
     };
 
-    Assignments(const TermSet& vars, const SortedTermSet* substitutes) : vars_(vars), substitutes_(substitutes) {}
+    // The assignments with index in [first, last).
+    class Chunk {
+     public:
+      Chunk(const Assignments* owner, size_t first, size_t last) : owner_(owner), first_(first), last_(last) {}
+
+      assignment_iterator begin() const { return assignment_iterator(owner_, first_); }
+      assignment_iterator end()   const { return assignment_iterator(owner_, last_); }
+
+     private:
+      const Assignments* owner_;
+      size_t first_;
+      size_t last_;
+    };
+
+    Assignments(const TermSet& vars, const SortedTermSet* substitutes) : vars_(vars.begin(), vars.end()) {
+      for (const Term var : vars_) {
+        assert(var.symbol().variable());
+        const TermSet& names = (*substitutes)[var.sort()];
+        domains_.emplace_back(names.begin(), names.end());
+        size_ *= names.size();
+      }
+    }
+
+    size_t size() const { return size_; }
 
-    assignment_iterator begin() const { return assignment_iterator(vars_, substitutes_); }
-    assignment_iterator end() const { return assignment_iterator(); }
+    assignment_iterator begin() const { return assignment_iterator(this, 0); }
+    assignment_iterator end()   const { return assignment_iterator(this, size_); }
+
+    Chunk chunk(size_t first, size_t last) const {
+      assert(first <= last && last <= size_);
+      return Chunk(this, first, last);
+    }
 
    private:
-    const TermSet vars_;
-    const SortedTermSet* substitutes_;
+    std::vector<Term> vars_;
+    std::vector<std::vector<Term>> domains_;
+    size_t size_ = 1;
   };
 
   struct PairHasher {
@@ -428,6 +665,519 @@ class Grounder {
     }
   };
 
+  // A clause compiled for instantiation. Its variables are numbered, and an
+  // assignment is given as a vector of names indexed by these numbers. Every
+  // term in the clause refers to its constant or its variable's number, so an
+  // instance is built by patching the literals in a buffer, without
+  // Term::Substitute() and without allocation. Every literal also remembers
+  // the arguments and the result of its last left-hand side. Assignments
+  // change the later variables more often, so the terms of the earlier ones
+  // are usually reused without calling CreateTerm(). Literals without function
+  // are instantiated first, so that an instance that is valid because of one
+  // of them, such as x != y for distinct names, is discarded early. The
+  // instance is sorted in the buffer and assigned to the Clause without
+  // minimizing it again.
+  class Template {
+   public:
+    // The variables of lhs, if given, are numbered first.
+    explicit Template(const Clause& c, Term lhs = Term()) {
+      if (!lhs.null()) {
+        lhs.Traverse([this](Term t) { AddVar(t); return true; });
+      }
+      for (const Literal a : c) {
+        a.Traverse([this](Term t) { AddVar(t); return true; });
+      }
+      std::vector<Literal> lits(c.begin(), c.end());
+      std::stable_partition(lits.begin(), lits.end(), [](Literal a) { return !a.lhs().function(); });
+      for (const Literal a : lits) {
+        Lit l;
+        l.pos = a.pos();
+        l.lhs = a.lhs();
+        l.args_begin = args_.size();
+        if (a.lhs().function()) {
+          assert(a.lhs().quasiprimitive());
+          for (const Term arg : a.lhs().args()) {
+            args_.push_back(slot(arg));
+          }
+        } else {
+          l.lhs_slot = slot(a.lhs());
+        }
+        l.rhs_slot = slot(a.rhs());
+        lits_.push_back(l);
+      }
+    }
+
+    const std::vector<Term>& vars() const { return vars_; }
+
+    // The buffers for Instantiate(); one per thread.
+    class Scratch {
+     public:
+      explicit Scratch(const Template& t) : last_args_(t.args_.size()), last_lhs_(t.lits_.size()) {
+        lits_.reserve(t.lits_.size());
+      }
+
+     private:
+      friend class Template;
+
+      std::vector<Literal> lits_;
+      Term::Vector args_;
+      std::vector<Term> last_args_;
+      std::vector<Term> last_lhs_;
+    };
+
+    // Sets c to the instance where vars()[i] is replaced with values[i], or
+    // returns false if that instance is valid.
+    bool Instantiate(const std::vector<Term>& values, Term::Factory* tf, Scratch* s, Clause* c) const {
+      assert(values.size() == vars_.size());
+      s->lits_.clear();
+      for (size_t i = 0; i < lits_.size(); ++i) {
+        const Lit& l = lits_[i];
+        if (!l.lhs.function()) {
+          const Literal a = l.pos ? Literal::Eq(get(l.lhs_slot, values), get(l.rhs_slot, values))
+                                  : Literal::Neq(get(l.lhs_slot, values), get(l.rhs_slot, values));
+          if (a.valid()) {
+            return false;
+          }
+          if (!a.invalid()) {
+            s->lits_.push_back(a);
+          }
+          continue;
+        }
+        const size_t arity = l.lhs.arity();
+        s->args_.resize(arity);
+        for (size_t j = 0; j < arity; ++j) {
+          s->args_[j] = get(args_[l.args_begin + j], values);
+        }
+        if (s->last_lhs_[i].null() ||
+            !std::equal(s->args_.begin(), s->args_.end(), s->last_args_.begin() + l.args_begin)) {
+          std::copy(s->args_.begin(), s->args_.end(), s->last_args_.begin() + l.args_begin);
+          s->last_lhs_[i] = tf->CreateTerm(l.lhs.symbol(), s->args_);
+        }
+        const Term lhs = s->last_lhs_[i];
+        const Term rhs = get(l.rhs_slot, values);
+        s->lits_.push_back(l.pos ? Literal::Eq(lhs, rhs) : Literal::Neq(lhs, rhs));
+      }
+      std::sort(s->lits_.begin(), s->lits_.end());
+      s->lits_.erase(std::unique(s->lits_.begin(), s->lits_.end()), s->lits_.end());
+      c->AssignMinimal(s->lits_.begin(), s->lits_.end());
+      return !c->valid();
+    }
+
+   private:
+    // A constant term or, if var < vars_.size(), the variable vars_[var].
+    struct Slot {
+      Term term;
+      size_t var;
+    };
+
+    struct Lit {
+      bool pos;
+      Term lhs;
+      size_t args_begin;
+      Slot lhs_slot;
+      Slot rhs_slot;
+    };
+
+    static Term get(const Slot& s, const std::vector<Term>& values) {
+      return s.var < values.size() ? values[s.var] : s.term;
+    }
+
+    void AddVar(Term t) {
+      if (t.variable() && std::find(vars_.begin(), vars_.end(), t) == vars_.end()) {
+        vars_.push_back(t);
+      }
+    }
+
+    Slot slot(Term t) const {
+      const size_t var = t.variable() ? std::find(vars_.begin(), vars_.end(), t) - vars_.begin() : vars_.size();
+      return Slot{t, t.variable() ? var : static_cast<size_t>(-1)};
+    }
+
+    std::vector<Term> vars_;
+    std::vector<Slot> args_;
+    std::vector<Lit> lits_;
+  };
+
+  // A non-ground or ground clause indexed by one of its left-hand sides for
+  // lazy grounding, see GroundRelevant(). The variables of lhs come first in
+  // the Template.
+  struct Pattern {
+    Term lhs;
+    Template tmpl;
+  };
+
+  // Calls f(c) for every non-valid instance c of a non-ground clause from
+  // clauses whose assignment uses at least one name from new_names or, if
+  // new_names is null, for every non-valid instance.
+  template<typename UnaryFunction>
+  void GroundNewAssignments(const std::list<Clause>& clauses, const SortedTermSet* new_names, UnaryFunction f) const {
+    if (pool_) {
+      GroundNewAssignmentsInParallel(clauses, new_names, f);
+      return;
+    }
+    for (const Clause& c : clauses) {
+      if (c.ground()) {
+        continue;
+      }
+      const Template tmpl(c);
+      Template::Scratch scratch(tmpl);
+      std::vector<Term> values(tmpl.vars().size());
+      Clause ci;
+      ForEachNewAssignment(new_names, tmpl.vars(), 0, !new_names, &values, [&]() {
+        if (tmpl.Instantiate(values, tf_, &scratch, &ci)) {
+          assert(ci.primitive());
+          f(ci);
+        }
+      });
+    }
+  }
+
+  template<typename UnaryFunction>
+  void GroundNewAssignmentsInParallel(const std::list<Clause>& clauses,
+                                      const SortedTermSet* new_names,
+                                      UnaryFunction f) const {
+    struct Task {
+      size_t tmpl;
+      Term name;
+    };
+    std::vector<Template> tmpls;
+    std::vector<Task> tasks;
+    for (const Clause& c : clauses) {
+      if (c.ground()) {
+        continue;
+      }
+      tmpls.emplace_back(c);
+      const std::vector<Term>& vars = tmpls.back().vars();
+      for (const Term x : vars) {
+        // IntMap::operator[] resizes the map, which must not happen in the tasks.
+        names_[x.sort()];
+        if (new_names) {
+          (*new_names)[x.sort()];
+        }
+      }
+      const Term x = vars.front();
+      for (const Term n : new_names && vars.size() == 1 ? (*new_names)[x.sort()] : names_[x.sort()]) {
+        tasks.push_back(Task{tmpls.size() - 1, n});
+      }
+    }
+    std::vector<std::vector<Clause>> buffers(tasks.size());
+    pool_->Run(tasks.size(), [this, new_names, &tmpls, &tasks, &buffers](size_t i, size_t) {
+      const Task& t = tasks[i];
+      const Template& tmpl = tmpls[t.tmpl];
+      Template::Scratch scratch(tmpl);
+      std::vector<Term> values(tmpl.vars().size());
+      values[0] = t.name;
+      const bool has_new_name = !new_names || new_names->contains(t.name);
+      Clause ci;
+      ForEachNewAssignment(new_names, tmpl.vars(), 1, has_new_name, &values, [&]() {
+        if (tmpl.Instantiate(values, tf_, &scratch, &ci)) {
+          assert(ci.primitive());
+          buffers[i].push_back(std::move(ci));
+        }
+      });
+    });
+    std::unordered_set<Clause> instances;
+    for (const std::vector<Clause>& buffer : buffers) {
+      for (const Clause& c : buffer) {
+        if (instances.insert(c).second) {
+          f(c);
+        }
+      }
+    }
+  }
+
+  // Sets (*values)[i], (*values)[i+1], ... to all assignments of vars[i],
+  // vars[i+1], ... to names_ and calls f() for those where some variable is
+  // mapped to a name from new_names; has_new_name indicates whether vars[0],
+  // ..., vars[i-1] are. If has_new_name holds initially, new_names may be null.
+  template<typename NullaryFunction>
+  void ForEachNewAssignment(const SortedTermSet* new_names,
+                            const std::vector<Term>& vars,
+                            size_t i,
+                            bool has_new_name,
+                            std::vector<Term>* values,
+                            NullaryFunction f) const {
+    if (i == vars.size()) {
+      if (has_new_name) {
+        f();
+      }
+      return;
+    }
+    const Term x = vars[i];
+    const bool last = i + 1 == vars.size();
+    for (const Term n : !has_new_name && last ? (*new_names)[x.sort()] : names_[x.sort()]) {
+      (*values)[i] = n;
+      ForEachNewAssignment(new_names, vars, i + 1, has_new_name || new_names->contains(n), values, f);
+    }
+  }
+
+  static std::vector<Pattern> Patterns(const Clause& c) {
+    TermSet lhss;
+    std::vector<Pattern> ps;
+    for (const Literal a : c) {
+      if (a.lhs().function() && lhss.insert(a.lhs()).second) {
+        ps.push_back(Pattern{a.lhs(), Template(c, a.lhs())});
+      }
+    }
+    return ps;
+  }
+
+  // Calls f(c, temporary) for every non-valid instance c of p's clause where
+  // p.lhs is mapped to t; if new_names is not null, only those instances are
+  // considered which use a name from new_names for a variable not in t. The
+  // flag temporary indicates whether the instance mentions a query name.
+  template<typename BinaryFunction>
+  void GroundPattern(const Pattern& p, Term t, const SortedTermSet* new_names, BinaryFunction f) const {
+    const std::vector<Term>& vars = p.tmpl.vars();
+    std::vector<Term> values(vars.size());
+    size_t n_bound = 0;
+    for (size_t i = 0; i < t.arity(); ++i) {
+      const Term x = p.lhs.arg(i);
+      const Term n = t.arg(i);
+      if (x.variable()) {
+        const size_t j = std::find(vars.begin(), vars.end(), x) - vars.begin();
+        if (values[j].null()) {
+          values[j] = n;
+          ++n_bound;
+        } else if (values[j] != n) {
+          return;
+        }
+      } else if (x != n) {
+        return;
+      }
+    }
+    Template::Scratch scratch(p.tmpl);
+    Clause ci;
+    ForEachNewAssignment(new_names, vars, n_bound, !new_names, &values, [&]() {
+      if (p.tmpl.Instantiate(values, tf_, &scratch, &ci)) {
+        assert(ci.primitive());
+        f(ci, std::any_of(values.begin(), values.end(), [this](Term n) { return query_names_.contains(n); }));
+      }
+    });
+  }
+
+  // Grounds the instances for the terms in seeds_ and, transitively, for the
+  // left-hand sides of these instances, except for those terms in closed_,
+  // whose instances have been grounded already. When clauses or names have
+  // been added, the respective instances for closed_ are grounded as well.
+  // Instances with query names only go to query_clauses_, the others are
+  // added to the Setup.
+  void GroundRelevant() {
+    if (!setup_) {
+      setup_ = internal::Just(Setup());
+      setup_.val.set_learn_nogoods(learn_nogoods_);
+    }
+    const bool changed = names_changed_ || !unprocessed_clauses_.empty();
+    if (!changed && seeds_.empty()) {
+      return;
+    }
+    overlay_ = nullptr;
+    TermSet queue;
+    std::swap(queue, seeds_);
+    std::unordered_set<Clause> instances;
+    bool added = false;
+    auto add = [this, &queue, &instances, &added](const Clause& c, bool temporary) {
+      if (!instances.insert(c).second) {
+        return;
+      }
+      for (const Literal a : c) {
+        queue.insert(a.lhs());
+      }
+      if (temporary) {
+        query_clauses_.push_back(c);
+      } else {
+        setup_.val.AddClause(c);
+        added = true;
+      }
+    };
+    if (changed) {
+      queue.insert(query_closed_.begin(), query_closed_.end());
+      query_closed_.clear();
+      query_clauses_.clear();
+      if (names_changed_) {
+        for (const Term t : closed_) {
+          for (const Pattern& p : patterns_[t.symbol()]) {
+            GroundPattern(p, t, &new_names_, add);
+          }
+        }
+      }
+      for (const Clause& c : unprocessed_clauses_) {
+        for (Pattern& p : Patterns(c)) {
+          for (const Term t : closed_) {
+            if (p.lhs.symbol() == t.symbol()) {
+              GroundPattern(p, t, nullptr, add);
+            }
+          }
+          patterns_[p.lhs.symbol()].push_back(std::move(p));
+        }
+      }
+      processed_clauses_.splice(processed_clauses_.begin(), unprocessed_clauses_);
+      names_changed_ = false;
+      new_names_.clear();
+    }
+    while (!queue.empty()) {
+      const Term t = *queue.begin();
+      queue.erase(queue.begin());
+      if (!t.function()) {
+        continue;
+      }
+      const bool temporary = std::any_of(t.args().begin(), t.args().end(),
+                                         [this](Term n) { return query_names_.contains(n); });
+      if (!(temporary ? query_closed_ : closed_).insert(t).second) {
+        continue;
+      }
+      auto it = patterns_.find(t.symbol());
+      if (it != patterns_.end()) {
+        for (const Pattern& p : it->second) {
+          GroundPattern(p, t, nullptr, add);
+        }
+      }
+    }
+    if (added) {
+      ++version_;
+      setup_.val.Minimize();
+    }
+  }
+
+  // Grounds the delta of this layer, see above, and puts it on top of the
+  // base's Setup unless it is there already.
+  const Setup& GroundLayer() {
+    assert(!base_->overlay_);
+    SyncWithBase();
+    if (base_->names_changed_ || !base_->unprocessed_clauses_.empty() || !base_->setup_) {
+      base_->Ground();
+    }
+    if (names_changed_ || !unprocessed_clauses_.empty() || !setup_) {
+      if (base_->layer_owner_ == layer_id_) {
+        base_->ReleaseLayer();
+      }
+      overlay_ = nullptr;
+      private_setup_ = internal::Nothing;
+      for (const TermSet& ns : query_names_.values()) {
+        for (const Term n : ns) {
+          names_.erase(n);
+        }
+      }
+      auto add = [this](const Clause& c) { setup_.val.AddClause(c); };
+      if (names_changed_ && setup_) {
+        const SortedTermSet new_extra_names = ExtraNames(new_names_);
+        GroundNewAssignments(processed_clauses_, &new_names_, add);
+        GroundNewAssignments(base_->processed_clauses_, &new_extra_names, add);
+      }
+      if (!setup_) {
+        setup_ = internal::Just(Setup());
+        setup_.val.set_learn_nogoods(learn_nogoods_);
+        const SortedTermSet extra_names = ExtraNames(names_);
+        GroundNewAssignments(base_->processed_clauses_, &extra_names, add);
+      }
+      for (const Clause& c : unprocessed_clauses_) {
+        if (c.ground()) {
+          assert(c.primitive());
+          if (!c.valid()) {
+            setup_.val.AddClause(c);
+          }
+        }
+      }
+      GroundNewAssignments(unprocessed_clauses_, nullptr, add);
+      processed_clauses_.splice(processed_clauses_.begin(), unprocessed_clauses_);
+      names_changed_ = false;
+      new_names_.clear();
+      setup_.val.Minimize();
+      names_.insert(query_names_);
+    }
+    if (private_layer_) {
+      return GroundPrivateLayer();
+    }
+    Setup& base = base_->setup_.val;
+    if (base_->layer_owner_ != layer_id_) {
+      base_->ReleaseLayer();
+      base_->layer_owner_ = layer_id_;
+      base_->layer_ = std::unique_ptr<Setup::ShallowCopy>(new Setup::ShallowCopy(base.shallow_copy()));
+      for (const size_t i : setup_.val.clauses()) {
+        base_->layer_->AddClause(setup_.val.clause(i));
+      }
+    }
+    const auto query_names = query_names_.values();
+    if (!base_->layer_query_ &&
+        std::any_of(query_names.begin(), query_names.end(), [](const TermSet& ns) { return !ns.empty(); })) {
+      base_->layer_query_ = std::unique_ptr<Setup::ShallowCopy>(new Setup::ShallowCopy(base.shallow_copy()));
+      auto add = [this](const Clause& c) { base_->layer_query_->AddClause(c); };
+      GroundNewAssignments(processed_clauses_, &query_names_, add);
+      GroundNewAssignments(base_->processed_clauses_, &query_names_, add);
+    }
+    return base;
+  }
+
+  // Puts the delta on an overlay of the base's Setup unless it is there
+  // already. Unlike GroundLayer(), this does not modify the base.
+  const Setup& GroundPrivateLayer() {
+    assert(base_->layer_owner_ == 0);
+    if (!private_setup_) {
+      assert(!overlay_);
+      private_setup_ = internal::Just(base_->setup_.val.Overlay());
+      for (const size_t i : setup_.val.clauses()) {
+        private_setup_.val.AddClause(setup_.val.clause(i));
+      }
+    }
+    const auto query_names = query_names_.values();
+    if (!overlay_ && std::any_of(query_names.begin(), query_names.end(), [](const TermSet& ns) { return !ns.empty(); })) {
+      overlay_ = std::unique_ptr<Setup::ShallowCopy>(new Setup::ShallowCopy(private_setup_.val.shallow_copy()));
+      auto add = [this](const Clause& c) { overlay_->AddClause(c); };
+      GroundNewAssignments(processed_clauses_, &query_names_, add);
+      GroundNewAssignments(base_->processed_clauses_, &query_names_, add);
+    }
+    return private_setup_.val;
+  }
+
+  // Takes over the names, plus names, split terms, and assignment literals
+  // of the base if its clauses or names have changed since the last call. In
+  // that case the delta is grounded anew, as new names of the base may also
+  // lead to new instances of base clauses with names the base does not know.
+  void SyncWithBase() {
+    const size_t n_clauses = base_->processed_clauses_.size() + base_->unprocessed_clauses_.size();
+    const size_t n_names = base_->names_.n_terms();
+    if (n_clauses == base_clauses_ && n_names == base_names_) {
+      return;
+    }
+    base_clauses_ = n_clauses;
+    base_names_ = n_names;
+    ++version_;
+    if (base_->layer_owner_ == layer_id_) {
+      base_->ReleaseLayer();
+    }
+    overlay_ = nullptr;
+    private_setup_ = internal::Nothing;
+    for (const Symbol::Sort sort : base_->plus_.keys()) {
+      plus_[sort] = std::max(plus_[sort], base_->plus_[sort]);
+    }
+    names_.insert(base_->names_);
+    splits_.insert(base_->splits_.begin(), base_->splits_.end());
+    assigns_.insert(base_->assigns_.begin(), base_->assigns_.end());
+    setup_ = internal::Nothing;
+    unprocessed_clauses_.splice(unprocessed_clauses_.begin(), processed_clauses_);
+    names_changed_ = false;
+    new_names_.clear();
+  }
+
+  // The names from names which the base does not know.
+  SortedTermSet ExtraNames(const SortedTermSet& names) const {
+    SortedTermSet extra;
+    for (const TermSet& ns : names.values()) {
+      for (const Term n : ns) {
+        if (!base_->names_.contains(n)) {
+          extra.insert(n);
+        }
+      }
+    }
+    return extra;
+  }
+
+  void ReleaseLayer() {
+    layer_query_ = nullptr;
+    layer_ = nullptr;
+    layer_owner_ = 0;
+  }
+
   template<typename T, typename U>
   void Ground(const T ungrounded, U* grounded_set) const {
     assert(ungrounded.quasiprimitive());
@@ -537,8 +1287,49 @@ class Grounder {
     }
   }
 
+  size_t AddName(Term n) {
+    if (query_names_.contains(n)) {
+      query_names_.erase(n);
+    } else if (names_.insert(n) == 0) {
+      return 0;
+    }
+    new_names_.insert(n);
+    ++version_;
+    return 1;
+  }
+
+  static const Formula& query(const Formula& phi) { return phi; }
+  static const Formula& query(const Formula::Ref& phi) { return *phi; }
+  static Term query(Term lhs) { return lhs; }
+
+  void AddQueryTerms(split_level k, const Formula& phi) {
+    assert(phi.objective());
+    if (lazy_) {
+      const TermSet terms = Ground(Mentioned<TermSet>([](Term t) { return t.function(); }, phi));
+      seeds_.insert(terms.begin(), terms.end());
+    }
+    if (k > 0) {
+      AddSplitTerms(Mentioned<TermSet>([](Term t) { return t.function(); }, phi));
+      AddAssignmentLiterals(Mentioned<LiteralSet>([](Literal a) { return a.lhs().function(); }, phi));
+    }
+  }
+
+  void AddQueryTerms(split_level k, Term lhs) {
+    if (lazy_) {
+      seeds_.insert(lhs);
+    }
+    if (k > 0) {
+      AddSplitTerms(Mentioned<TermSet>([](Term t) { return t.function(); }, lhs));
+    }
+  }
+
   bool AddMentionedNames(const SortedTermSet& names) {
-    const size_t added = names_.insert(names);
+    size_t added = 0;
+    for (const TermSet& ns : names.values()) {
+      for (const Term n : ns) {
+        added += AddName(n);
+      }
+    }
     return added > 0;
   }
 
@@ -551,18 +1342,34 @@ class Grounder {
         plus_[sort] = n;
         n -= m;
         while (n-- > 0) {
-          added += names_.insert(CreateName(sort));
+          added += AddName(CreateName(sort));
         }
       }
     }
     return added > 0;
   }
 
+  void AddQueryNames(const PlusMap& plus) {
+    for (const Symbol::Sort sort : plus.keys()) {
+      for (size_t n = plus[sort]; n > plus_[sort]; --n) {
+        Term name;
+        do {
+          name = CreateName(sort);
+        } while (names_.contains(name));
+        names_.insert(name);
+        query_names_.insert(name);
+      }
+    }
+  }
+
   void AddSplitTerms(const TermSet& terms) {
     size_t added = 0;
     for (Term t : terms) {
       added += splits_.insert(t).second ? 1 : 0;
     }
+    if (added > 0) {
+      ++version_;
+    }
   }
 
   template<typename SourceQueue, typename Sink, typename UnaryPredicate>
@@ -582,69 +1389,143 @@ class Grounder {
       queue->erase(queue->begin());
       auto p = sink->insert(elem);
       if (p.second) {
-        for (size_t i : s.clauses()) {
+        s.ForEachClauseMentioning(lhs(elem), [&](size_t i) {
           if (done->find(i) != done->end()) {
-            continue;
+            return;
           }
           const Clause c = s.clause(i);
           if (c.unit() && c.first().pos()) {
-            continue;
+            return;
           }
           if (collect(c, elem, queue)) {
             done->insert(i);
           }
-        }
+        });
       }
     }
   }
 
-  void AddAssignmentLiteralsTo(const LiteralSet& lits, LiteralSet* assigns) {
+  static Term lhs(Term t) { return t; }
+  static Term lhs(Literal a) { return a.lhs(); }
+
+  // A negative literal is replaced by an assignment of any name to its
+  // left-hand side, for which one variable per sort suffices, so that the
+  // same literal is not added again with a fresh variable by every query.
+  size_t AddAssignmentLiteralsTo(const LiteralSet& lits, LiteralSet* assigns) {
+    size_t added = 0;
     for (Literal a : lits) {
       if (!a.pos()) {
-        const Term x = tf_->CreateTerm(sf_->CreateVariable(a.rhs().sort()));
+        Term& x = assign_vars_[a.rhs().sort()];
+        if (x.null()) {
+          x = tf_->CreateTerm(sf_->CreateVariable(a.rhs().sort()));
+        }
         a = Literal::Eq(a.lhs(), x);
       }
-      assigns->insert(a);
+      added += assigns->insert(a).second ? 1 : 0;
     }
+    return added;
   }
 
   void AddAssignmentLiterals(const LiteralSet& lits) {
-    AddAssignmentLiteralsTo(lits, &assigns_);
+    if (AddAssignmentLiteralsTo(lits, &assigns_) > 0) {
+      ++version_;
+    }
   }
 
-  LiteralAssignmentSet LiteralAssignments(const LiteralSet& assigns) const {
-    LiteralSet ground = Ground(assigns);
-    struct Func {  // a Lambda doesn't have assignment operators
-      LiteralSet operator()(Literal a) const { return LiteralSet{a}; }
-    };
-    auto r = internal::transform_range(ground.begin(), ground.end(), Func());
-    LiteralAssignmentSet sets(r.begin(), r.end());
-    for (Literal a : ground) {
-      for (auto it = sets.begin(); it != sets.end(); ) {
-        const LiteralSet& set = *it;
-        assert(!set.empty());
-        const Literal b = *set.begin();
-        if (a.lhs().symbol() == b.lhs().symbol() && set.find(a) == set.end() && Literal::Isomorphic(a, b)) {
-          if (set.size() == 1) {
-            LiteralSet new_set = set;
-            new_set.insert(a);
-            const float prev_load_factor = sets.load_factor();
-            const float prev_size = sets.size();
-            sets.insert(new_set);
-            if (sets.size() > prev_size && sets.load_factor() <= prev_load_factor) {
-              it = sets.begin();
-            } else {
-              ++it;
-            }
-          } else {
-            LiteralSet new_set = set;
-            new_set.insert(a);
-            it = sets.erase(it);
-            sets.insert(new_set);
+  // Two literals are isomorphic if they have the same right-hand side and
+  // their left-hand sides are equal modulo a bijection of the names and
+  // variables that fixes the right-hand side. IsomorphismHash and
+  // IsomorphismEquals look at the canonical form of a literal, where every
+  // name or variable is replaced by the position of its first occurrence, so
+  // that isomorphic literals fall into the same bucket of a hash map.
+  struct IsomorphismHash {
+    internal::hash32_t operator()(Literal a) const {
+      std::vector<Term> atoms{a.rhs()};
+      internal::hash32_t h = (a.pos() ? 1 : 0) ^ a.rhs().hash();
+      Hash(a.lhs(), &atoms, &h);
+      return h;
+    }
+
+   private:
+    static void Hash(Term t, std::vector<Term>* atoms, internal::hash32_t* h) {
+      if (t.function()) {
+        *h = (*h ^ t.symbol().hash()) * 0x01000193;
+        for (const Term arg : t.args()) {
+          Hash(arg, atoms, h);
+        }
+      } else {
+        const internal::u32 i = Position(t, atoms);
+        *h = (*h ^ internal::jenkins_hash((i << 9) | (static_cast<internal::u32>(t.sort()) << 1) | t.name())) *
+             0x01000193;
+      }
+    }
+  };
+
+  struct IsomorphismEquals {
+    bool operator()(Literal a, Literal b) const {
+      std::vector<Term> atoms_a{a.rhs()};
+      std::vector<Term> atoms_b{b.rhs()};
+      return a.pos() == b.pos() && a.rhs() == b.rhs() &&
+             Equals(a.lhs(), b.lhs(), &atoms_a, &atoms_b);
+    }
+
+   private:
+    static bool Equals(Term t, Term u, std::vector<Term>* atoms_t, std::vector<Term>* atoms_u) {
+      if (t.function() || u.function()) {
+        if (!t.function() || !u.function() || t.symbol() != u.symbol()) {
+          return false;
+        }
+        for (Symbol::Arity i = 0; i < t.arity(); ++i) {
+          if (!Equals(t.arg(i), u.arg(i), atoms_t, atoms_u)) {
+            return false;
           }
-        } else {
-          ++it;
         }
+        return true;
+      }
+      return t.name() == u.name() && t.sort() == u.sort() && Position(t, atoms_t) == Position(u, atoms_u);
+    }
+  };
+
+  // Returns the index of t in atoms, appending it if necessary.
+  static internal::u32 Position(Term t, std::vector<Term>* atoms) {
+    const auto it = std::find(atoms->begin(), atoms->end(), t);
+    if (it != atoms->end()) {
+      return it - atoms->begin();
+    }
+    atoms->push_back(t);
+    return atoms->size() - 1;
+  }
+
+  // Every ground literal is an assignment on its own, and every class of two
+  // or more isomorphic literals is another one, which assigns the same value
+  // to all terms of a function symbol whose arguments are alike.
+  LiteralAssignmentSet LiteralAssignments(const LiteralSet& assigns) const {
+    const LiteralSet ground = Ground(assigns);
+    const std::vector<Literal> lits(ground.begin(), ground.end());
+    std::unordered_map<Literal, size_t, IsomorphismHash, IsomorphismEquals> classes;
+    std::vector<size_t> class_of(lits.size());
+    std::vector<size_t> offsets;
+    LiteralAssignmentSet sets;
+    for (size_t i = 0; i < lits.size(); ++i) {
+      sets.Add(&lits[i], &lits[i] + 1);
+      const auto p = classes.insert(std::make_pair(lits[i], offsets.size()));
+      if (p.second) {
+        offsets.push_back(0);
+      }
+      class_of[i] = p.first->second;
+      ++offsets[class_of[i]];
+    }
+    // Counting sort by class, afterwards offsets[c] is where class c begins.
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<Literal> members(lits.size());
+    for (size_t i = lits.size(); i > 0; --i) {
+      members[--offsets[class_of[i - 1]]] = lits[i - 1];
+    }
+    for (size_t c = 0; c < offsets.size(); ++c) {
+      const size_t begin = offsets[c];
+      const size_t end = c + 1 < offsets.size() ? offsets[c + 1] : members.size();
+      if (end - begin > 1) {
+        sets.Add(members.begin() + begin, members.begin() + end);
       }
     }
     return sets;
@@ -655,12 +1536,41 @@ class Grounder {
   PlusMap plus_;
   TermSet splits_;
   LiteralSet assigns_;
+  internal::IntMap<Symbol::Sort, Term> assign_vars_;
   SortedTermSet names_;
+  SortedTermSet new_names_;
+  SortedTermSet query_names_;
   bool names_changed_ = false;
+  size_t version_ = 0;
   std::list<Clause> processed_clauses_;
   std::list<Clause> unprocessed_clauses_;
   SortedTermSet owned_names_;
   internal::Maybe<Setup> setup_;
+  internal::Maybe<Setup> private_setup_;  // overlay of the base's Setup with the delta of a private layer
+  std::unique_ptr<Setup::ShallowCopy> overlay_;
+  bool lazy_ = false;
+  internal::ThreadPool* pool_ = nullptr;
+  TermSet seeds_;
+  TermSet closed_;
+  TermSet query_closed_;
+  std::vector<Clause> query_clauses_;
+  std::unordered_map<Symbol, std::vector<Pattern>> patterns_;
+  bool learn_nogoods_ = true;
+  // For a layer: the base, the number of the layer, and the numbers of the
+  // base's clauses and names as of the last SyncWithBase(), and whether it
+  // is private.
+  Grounder* base_ = nullptr;
+  size_t layer_id_ = 0;
+  size_t base_clauses_ = 0;
+  size_t base_names_ = 0;
+  bool private_layer_ = false;
+  // For a base: the shallow copies of the Setup for the layer numbered
+  // layer_owner_, if any, and for its current query, and the number of
+  // layers so far.
+  std::unique_ptr<Setup::ShallowCopy> layer_;
+  std::unique_ptr<Setup::ShallowCopy> layer_query_;
+  size_t layer_owner_ = 0;
+  size_t n_layers_ = 0;
 };
 
 }  // namespace limbo
@@ -6,7 +6,8 @@
 // to be small and sparse, as their size corresponds to the size of the
 // underlying array. Unset values are implicitly set to a null value, which by
 // default is T(), which amounts to 0 for integers and false for bools; the
-// value can be changed by set_null_value().
+// value can be changed by set_null_value(). Only the non-const operator[]
+// resizes the array, so a const IntMap can be read by several threads.
 
 #ifndef LIMBO_INTERNAL_INTMAP_H_
 #define LIMBO_INTERNAL_INTMAP_H_
@@ -41,7 +42,8 @@ class IntMap : public std::vector<T> {
   }
 
   typename parent::const_reference operator[](Key pos) const {
-    return const_cast<IntMap*>(this)->operator[](pos);
+    typename parent::size_type pos_int = static_cast<typename parent::size_type>(pos);
+    return pos_int < parent::size() ? parent::operator[](pos_int) : null_;
   }
 
   struct Keys {
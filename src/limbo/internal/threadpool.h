@@ -0,0 +1,175 @@
+// vim:filetype=cpp:textwidth=120:shiftwidth=2:softtabstop=2:expandtab
+// Copyright 2017 Christoph Schwering
+// Licensed under the MIT license. See LICENSE file in the project root.
+//
+// A ThreadPool with work stealing. Run() distributes a batch of tasks over the
+// queues of the workers and blocks until all of them are done. Every worker
+// takes tasks from the back of its own queue and, when it runs dry, steals
+// from the front of the other queues. The calling thread of Run() does not
+// idle either, it steals tasks like a worker.
+//
+// Each task is told the index of the thread that executes it, which is less
+// than size() for workers and size() for the calling thread. At most one task
+// runs on a thread at any time, so per-thread data can be accessed without
+// synchronization when indexed accordingly.
+
+#ifndef LIMBO_INTERNAL_THREADPOOL_H_
+#define LIMBO_INTERNAL_THREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <limbo/internal/ints.h>
+
+namespace limbo {
+namespace internal {
+
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t n_workers) : queues_(n_workers) {
+    for (size_t i = 0; i < n_workers; ++i) {
+      queues_[i] = std::unique_ptr<Queue>(new Queue());
+    }
+    for (size_t i = 0; i < n_workers; ++i) {
+      threads_.emplace_back([this, i]() { Work(i); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread& t : threads_) {
+      t.join();
+    }
+  }
+
+  size_t size() const { return threads_.size(); }
+
+  // Calls task(i, thread) for all i < n_tasks and returns when all calls have
+  // returned.
+  template<typename BinaryFunction>
+  void Run(size_t n_tasks, BinaryFunction task) {
+    Batch batch(n_tasks);
+    if (!queues_.empty()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      n_pending_ += n_tasks;
+    }
+    for (size_t i = 0; i < n_tasks; ++i) {
+      Task t = [&batch, &task, i](size_t thread) {
+        task(i, thread);
+        batch.Done();
+      };
+      if (queues_.empty()) {
+        t(size());
+      } else {
+        Queue* q = queues_[i % queues_.size()].get();
+        std::lock_guard<std::mutex> lock(q->mutex);
+        q->tasks.push_back(std::move(t));
+      }
+    }
+    if (!queues_.empty()) {
+      work_available_.notify_all();
+      Task t;
+      while (Steal(size(), &t)) {
+        t(size());
+      }
+    }
+    batch.Wait();
+  }
+
+ private:
+  typedef std::function<void(size_t)> Task;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  class Batch {
+   public:
+    explicit Batch(size_t n) : n_left_(n) {}
+
+    void Done() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--n_left_ == 0) {
+        done_.notify_all();
+      }
+    }
+
+    void Wait() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this]() { return n_left_ == 0; });
+    }
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable done_;
+    size_t n_left_;
+  };
+
+  // Takes a task from the back of the own queue or from the front of another
+  // queue. The calling thread of Run() has no queue of its own.
+  bool Steal(size_t thread, Task* t) {
+    for (size_t j = 0; j < queues_.size(); ++j) {
+      const size_t i = (thread + j) % queues_.size();
+      Queue* q = queues_[i].get();
+      std::lock_guard<std::mutex> lock(q->mutex);
+      if (!q->tasks.empty()) {
+        if (i == thread) {
+          *t = std::move(q->tasks.back());
+          q->tasks.pop_back();
+        } else {
+          *t = std::move(q->tasks.front());
+          q->tasks.pop_front();
+        }
+        std::lock_guard<std::mutex> lock_pending(mutex_);
+        --n_pending_;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Work(size_t thread) {
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_available_.wait(lock, [this]() { return stop_ || n_pending_ > 0; });
+        if (stop_) {
+          return;
+        }
+      }
+      Task t;
+      while (Steal(thread, &t)) {
+        t(thread);
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  size_t n_pending_ = 0;
+  bool stop_ = false;
+};
+
+}  // namespace internal
+}  // namespace limbo
+
+#endif  // LIMBO_INTERNAL_THREADPOOL_H_
+
@@ -20,14 +20,47 @@
 // matter; they control how much effort is put into constructing the system of
 // spheres.
 //
+// Every sphere consists of the knowledge and the clauses of some of the
+// conditionals. The knowledge is hence kept in a Grounder of its own, which
+// serves as base for the spheres' Grounders (see Grounder::set_base()), so
+// it is grounded and stored only once, and each sphere only adds the clauses
+// of its conditionals.
+//
+// With set_threads(), the spheres are evaluated concurrently for a
+// Formula::Bel() in a query. Once the antecedent is found to be consistent
+// with a sphere, the following spheres are irrelevant: those whose evaluation
+// has not begun yet are skipped, and those under way stop before their next
+// query to the Solver. The spheres are then private layers on the base (see
+// Grounder::set_private_layer()), so the knowledge is still grounded once,
+// before the spheres are evaluated, and each sphere only reads its Setup.
+//
 // Queries are not subject to any syntactic restrictions. Technically, they are
 // evaluated using variants of Levesque's representation theorem.
+//
+// By default, the system of spheres is rebuilt from scratch whenever a
+// conditional was added. With set_incremental_spheres(), the existing spheres
+// are kept instead, and only the conditionals added since are ranked: the
+// clause of a new conditional is added to the spheres in order until its
+// antecedent is possibly consistent, and only the conditionals ranked in the
+// spheres touched on the way are checked again. Conditionals of higher rank
+// need not be checked, as adding a clause does not make their antecedents
+// consistent, unless the new clause brings new names into the sphere. Neither
+// need conditionals with consistency guarantee whose function symbols are
+// not connected to those of the new clause by any clause. The spheres are
+// rebuilt nonetheless when the rank of another conditional would change, when
+// the plausibility of an antecedent is not consistent, when a sphere becomes
+// inconsistent, or when clauses were added to the knowledge since the last
+// build.
 
 #ifndef LIMBO_KB_H_
 #define LIMBO_KB_H_
 
 #include <cassert>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -41,6 +74,7 @@
 #include <limbo/internal/ints.h>
 #include <limbo/internal/iter.h>
 #include <limbo/internal/maybe.h>
+#include <limbo/internal/threadpool.h>
 
 namespace limbo {
 
@@ -49,8 +83,9 @@ class KnowledgeBase {
   typedef internal::size_t size_t;
   typedef size_t sphere_index;
 
-  KnowledgeBase(Symbol::Factory* sf, Term::Factory* tf) : sf_(sf), tf_(tf), objective_(sf, tf) {
-    spheres_.push_back(Solver(sf, tf));
+  KnowledgeBase(Symbol::Factory* sf, Term::Factory* tf)
+      : sf_(sf), tf_(tf), base_(new Grounder(sf, tf)), objective_(sf, tf) {
+    spheres_.push_back(NewSphere());
   }
 
   KnowledgeBase(const KnowledgeBase&) = delete;
@@ -59,11 +94,10 @@ class KnowledgeBase {
   KnowledgeBase& operator=(KnowledgeBase&&) = default;
 
   void Add(const Clause& c) {
-    for (Solver& sphere : spheres_) {
-      sphere.AddClause(c);
-    }
+    base_->AddClause(c);
     knowledge_.push_back(c);
-    c.Traverse([this](Term t) { if (t.name()) names_.insert(t); return true; });
+    memos_.clear();
+    Connect(c);
   }
 
   bool Add(const Formula& alpha) {
@@ -98,13 +132,26 @@ class KnowledgeBase {
     if (spheres_changed_) {
       BuildSpheres();
       spheres_changed_ = false;
+      memos_.clear();
     }
+    memos_.resize(n_spheres());
     Formula::Ref sigma_nf = sigma.NF(sf_, tf_);
     Formula::Ref phi = ReduceModalities(*sigma_nf, false);
     assert(phi->objective());
     return objective_.Entails(0, *phi, Solver::kNoConsistencyGuarantee);
   }
 
+  void set_incremental_spheres(bool b) { incremental_spheres_ = b; }
+
+  // Evaluates the spheres for a Formula::Bel() on n_threads threads, including
+  // the calling thread; n_threads <= 1 disables it. The spheres are rebuilt.
+  void set_threads(size_t n_threads) {
+    pool_ = n_threads > 1 ? std::unique_ptr<internal::ThreadPool>(new internal::ThreadPool(n_threads - 1)) : nullptr;
+    RebuildSpheres();
+    spheres_changed_ = false;
+    memos_.clear();
+  }
+
   sphere_index n_spheres() const { return spheres_.size(); }
   Solver* sphere(sphere_index p) { return &spheres_[p]; }
   const Solver& sphere(sphere_index p) const { return spheres_[p]; }
@@ -117,49 +164,83 @@ class KnowledgeBase {
     Formula::Ref ante;
     Clause not_ante_or_conse;
     bool assume_consistent;
+    internal::Maybe<size_t> node;  // of some function symbol of ante or not_ante_or_conse
   };
   typedef Grounder::TermSet TermSet;
   typedef Grounder::SortedTermSet SortedTermSet;
 
+  // The results of a sphere's Solver for the ground formulas Res() has
+  // reduced a query to. A result is keyed by the kind of the query (see
+  // ResQuery()) and the formula, where the names not mentioned by the sphere
+  // are replaced by placeholders, as the sphere cannot tell them apart. The
+  // memo is cleared whenever the spheres change; each sphere has its own, so
+  // that the spheres can be evaluated concurrently.
+  struct ResMemo {
+    struct Key {
+      bool operator==(const Key& key) const { return query == key.query && *phi == *key.phi; }
+
+      size_t query;
+      Formula::Ref phi;
+    };
+
+    struct KeyHash {
+      internal::hash32_t operator()(const Key& key) const {
+        internal::hash32_t h = internal::jenkins_hash(static_cast<internal::u32>(key.query));
+        key.phi->Traverse([&h](Literal a) { h = (h * 31) ^ a.hash(); return true; });
+        return h;
+      }
+    };
+
+    internal::Maybe<SortedTermSet> names;
+    internal::IntMap<Symbol::Sort, std::vector<Term>> placeholders;
+    std::unordered_map<Key, bool, KeyHash> results;
+  };
+
   void Add(Formula::split_level k, Formula::split_level l,
            const Formula& antecedent, const Clause& not_antecedent_or_consequent, bool assume_consistent) {
-    beliefs_.push_back(Conditional{k, l, antecedent.Clone(), not_antecedent_or_consequent, assume_consistent});
+    beliefs_.push_back(Conditional{k, l, antecedent.Clone(), not_antecedent_or_consequent, assume_consistent,
+                                   Connect(not_antecedent_or_consequent, Connect(antecedent))});
     spheres_changed_ = true;
-    antecedent.Traverse([this](Term t) { if (t.name()) names_.insert(t); return true; });
-    not_antecedent_or_consequent.Traverse([this](Term t) { if (t.name()) names_.insert(t); return true; });
   }
 
   void BuildSpheres() {
+    if (incremental_spheres_ && plausibility_consistent_ && (ranks_.empty() || n_knowledge_ == knowledge_.size())) {
+      size_t i = ranks_.size();
+      while (i < beliefs_.size() && RankIncrementally(i)) {
+        ++i;
+      }
+      if (i == beliefs_.size()) {
+        return;
+      }
+    }
+    RebuildSpheres();
+  }
+
+  void RebuildSpheres() {
     spheres_.clear();
-    std::vector<bool> done(beliefs_.size(), false);
+    ranks_.assign(beliefs_.size(), internal::Nothing);
+    plausibility_consistent_ = true;
+    n_knowledge_ = knowledge_.size();
     bool is_plausibility_consistent = true;
     size_t n_done = 0;
     size_t last_n_done;
     do {
       last_n_done = n_done;
-      Solver sphere(sf_, tf_);
-      for (const Clause& c : knowledge_) {
-        sphere.AddClause(c);
-      }
+      Solver sphere = NewSphere();
       for (size_t i = 0; i < beliefs_.size(); ++i) {
-        const Conditional& c = beliefs_[i];
-        if (!done[i]) {
-          sphere.AddClause(c.not_ante_or_conse);
+        if (!ranks_[i]) {
+          sphere.AddClause(beliefs_[i].not_ante_or_conse);
         }
       }
       bool next_is_plausibility_consistent = true;
       for (size_t i = 0; i < beliefs_.size(); ++i) {
         const Conditional& c = beliefs_[i];
-        if (!done[i]) {
-          const bool possibly_consistent = !sphere.Entails(c.k, *Formula::Factory::Not(c.ante->Clone()),
-                                                           c.assume_consistent);
-          if (possibly_consistent) {
-            done[i] = true;
-            ++n_done;
-            const bool necessarilyConsistent = sphere.Consistent(c.l, *c.ante, c.assume_consistent);
-            if (!necessarilyConsistent) {
-              next_is_plausibility_consistent = false;
-            }
+        if (!ranks_[i] && PossiblyConsistent(&sphere, c)) {
+          ranks_[i] = internal::Just(spheres_.size());
+          ++n_done;
+          if (!NecessarilyConsistent(&sphere, c)) {
+            next_is_plausibility_consistent = false;
+            plausibility_consistent_ = false;
           }
         }
       }
@@ -170,8 +251,118 @@ class KnowledgeBase {
     } while (n_done > last_n_done);
   }
 
+  // Ranks the i-th conditional in the existing spheres, provided that all
+  // earlier ones are ranked and every iteration of RebuildSpheres() has led
+  // to a sphere, so that the rank of a conditional is the index of its
+  // sphere. Returns false when the spheres need to be rebuilt.
+  bool RankIncrementally(size_t i) {
+    assert(ranks_.size() == i);
+    const Conditional& c = beliefs_[i];
+    for (sphere_index p = 0; p < spheres_.size(); ++p) {
+      Solver* sphere = &spheres_[p];
+      const size_t n_names = sphere->grounder()->Names().n_terms();
+      sphere->AddClause(c.not_ante_or_conse);
+      const bool new_names = sphere->grounder()->Names().n_terms() != n_names;
+      if (sphere->setup().contains_empty_clause()) {
+        return false;
+      }
+      for (size_t j = 0; j < i; ++j) {
+        if (ranks_[j] == internal::Just(p) && (new_names || !Unrelated(i, j))) {
+          if (!PossiblyConsistent(sphere, beliefs_[j]) || !NecessarilyConsistent(sphere, beliefs_[j])) {
+            return false;
+          }
+        } else if (new_names && (!ranks_[j] || ranks_[j].val > p)) {
+          if (PossiblyConsistent(sphere, beliefs_[j])) {
+            return false;
+          }
+        }
+      }
+      if (PossiblyConsistent(sphere, c)) {
+        if (!NecessarilyConsistent(sphere, c)) {
+          return false;
+        }
+        ranks_.push_back(internal::Just(p));
+        if (p + 1 == spheres_.size()) {
+          // The last sphere is left without this conditional, so it needs a
+          // successor with the unranked conditionals only.
+          Solver last = NewSphere();
+          for (size_t j = 0; j < i; ++j) {
+            if (!ranks_[j]) {
+              last.AddClause(beliefs_[j].not_ante_or_conse);
+            }
+          }
+          spheres_.push_back(std::move(last));
+        }
+        return true;
+      }
+    }
+    ranks_.push_back(internal::Nothing);
+    return true;
+  }
+
+  // Connects the function symbols mentioned in obj with each other and with
+  // the symbol of node n, if given, and returns the node of one of them.
+  template<typename T>
+  internal::Maybe<size_t> Connect(const T& obj, internal::Maybe<size_t> n = internal::Nothing) {
+    obj.Traverse([this, &n](Term t) {
+      if (t.function()) {
+        const size_t m = node(t.symbol());
+        if (n) {
+          components_[component(n.val)] = component(m);
+        } else {
+          n = internal::Just(m);
+        }
+      }
+      return true;
+    });
+    return n;
+  }
+
+  size_t node(Symbol f) {
+    auto p = nodes_.emplace(f, components_.size());
+    if (p.second) {
+      components_.push_back(components_.size());
+    }
+    return p.first->second;
+  }
+
+  size_t component(size_t n) {
+    while (components_[n] != n) {
+      components_[n] = components_[components_[n]];
+      n = components_[n];
+    }
+    return n;
+  }
+
+  // Under a consistency guarantee, the rank of the j-th conditional only
+  // depends on the clauses connected to its function symbols, so the clause
+  // of the i-th conditional cannot change it if they are not connected.
+  bool Unrelated(size_t i, size_t j) {
+    const Conditional& c = beliefs_[i];
+    const Conditional& d = beliefs_[j];
+    return d.assume_consistent && c.node && d.node && component(c.node.val) != component(d.node.val);
+  }
+
+  static bool PossiblyConsistent(Solver* sphere, const Conditional& c) {
+    return !sphere->Entails(c.k, *Formula::Factory::Not(c.ante->Clone()), c.assume_consistent);
+  }
+
+  static bool NecessarilyConsistent(Solver* sphere, const Conditional& c) {
+    return sphere->Consistent(c.l, *c.ante, c.assume_consistent);
+  }
+
+  // A sphere is a layer on top of base_, which holds the knowledge, so that
+  // the knowledge is grounded once for all spheres. The layer is private when
+  // the spheres are evaluated concurrently.
+  Solver NewSphere() {
+    Solver sphere(sf_, tf_);
+    sphere.grounder()->set_base(base_.get());
+    sphere.grounder()->set_private_layer(bool(pool_));
+    return sphere;
+  }
+
   Formula::Ref ReduceModalities(const Formula& alpha, bool assume_consistent) {
-    if (alpha.objective()) {
+    if (alpha.objective() && alpha.type() != Formula::kGuarantee) {
       return alpha.Clone();
     }
     switch (alpha.type()) {
@@ -208,14 +399,18 @@ class KnowledgeBase {
         const Formula::split_level l = alpha.as_bel().l();
         std::vector<Formula::Ref> consistent;
         std::vector<Formula::Ref> entails;
-        for (sphere_index p = 0; p < n_spheres(); ++p) {
-          consistent.push_back(ResConsistent(p, l, *ante, assume_consistent));
-          entails.push_back(ResEntails(p, k, *not_ante_or_conse, assume_consistent));
-          // The above calls to ResConsistent() and ResEntails() are potentially
-          // very expensive, so we should abort this loop when the subsequent
-          // spheres are clearly irrelevant.
-          if (consistent.back()->trivially_valid()) {
-            break;
+        if (pool_) {
+          ResBelInParallel(k, l, *ante, *not_ante_or_conse, assume_consistent, &consistent, &entails);
+        } else {
+          for (sphere_index p = 0; p < n_spheres(); ++p) {
+            consistent.push_back(ResConsistent(p, l, *ante, assume_consistent));
+            entails.push_back(ResEntails(p, k, *not_ante_or_conse, assume_consistent));
+            // The above calls to ResConsistent() and ResEntails() are potentially
+            // very expensive, so we should abort this loop when the subsequent
+            // spheres are clearly irrelevant.
+            if (consistent.back()->trivially_valid()) {
+              break;
+            }
           }
         }
         Formula::Ref phi;
@@ -241,7 +436,52 @@ class KnowledgeBase {
     throw;
   }
 
+  // Evaluates the spheres like the loop in ReduceModalities(), but one task per
+  // sphere. The knowledge is grounded beforehand, so that the tasks only read
+  // base_. Besides that, they only share last, the index of the first sphere
+  // found so far whose consistency result is trivially valid; a task for a
+  // later sphere stops as soon as it notices, see Cancelled(), and the
+  // results for later spheres are dropped.
+  void ResBelInParallel(Formula::split_level k,
+                        Formula::split_level l,
+                        const Formula& ante,
+                        const Formula& not_ante_or_conse,
+                        bool assume_consistent,
+                        std::vector<Formula::Ref>* consistent,
+                        std::vector<Formula::Ref>* entails) {
+    consistent->resize(n_spheres());
+    entails->resize(n_spheres());
+    base_->Ground();
+    std::atomic<sphere_index> last(n_spheres() - 1);
+    last_sphere_ = &last;
+    pool_->Run(n_spheres(), [&](size_t p, size_t) {
+      if (Cancelled(p)) {
+        return;
+      }
+      (*consistent)[p] = ResConsistent(p, l, ante, assume_consistent);
+      if (!Cancelled(p) && (*consistent)[p]->trivially_valid()) {
+        sphere_index q = last;
+        while (p < q && !last.compare_exchange_weak(q, p)) {
+        }
+      }
+      if (!Cancelled(p)) {
+        (*entails)[p] = ResEntails(p, k, not_ante_or_conse, assume_consistent);
+      }
+    });
+    last_sphere_ = nullptr;
+    consistent->resize(last + 1);
+    entails->resize(last + 1);
+  }
+
+  // Whether ResBelInParallel() has found an earlier sphere than p whose
+  // consistency result is trivially valid, so that the results for p are
+  // dropped anyway.
+  bool Cancelled(sphere_index p) const { return last_sphere_ && p > last_sphere_->load(); }
+
   Formula::Ref ResEntails(sphere_index p, Formula::split_level k, const Formula& phi, bool assume_consistent) {
+    if (Cancelled(p)) {
+      return bool_to_formula(false);
+    }
     // If phi is just a literal (t = n) or (t = x) for primitive t, we can use Solver::Determines to speed things up.
     if (phi.type() == Formula::kAtomic) {
       const Clause& c = phi.as_atomic().arg();
@@ -268,73 +508,142 @@ class KnowledgeBase {
     auto if_no_free_vars = [k, assume_consistent, this](Solver* sphere, const Formula& psi) {
       return sphere->Entails(k, psi, assume_consistent);
     };
-    return Res(p, phi.Clone(), if_no_free_vars);
+    return Res(p, phi.Clone(), ResQuery(true, k, assume_consistent), if_no_free_vars);
   }
 
   Formula::Ref ResConsistent(sphere_index p, Formula::split_level k, const Formula& phi, bool assume_consistent) {
     auto if_no_free_vars = [k, assume_consistent, this](Solver* sphere, const Formula& psi) {
       return sphere->Consistent(k, psi, assume_consistent);
     };
-    return Res(p, phi.Clone(), if_no_free_vars);
+    return Res(p, phi.Clone(), ResQuery(false, k, assume_consistent), if_no_free_vars);
   }
 
-  template<typename BinaryPredicate>
-  Formula::Ref Res(sphere_index p, Formula::Ref phi, BinaryPredicate if_no_free_vars) {
-    SortedTermSet names = names_;
-    phi->Traverse([&names](Term t) { if (t.name()) names.insert(t); return true; });
-    return Res(p, std::move(phi), &names, if_no_free_vars);
+  static size_t ResQuery(bool entails, Formula::split_level k, bool assume_consistent) {
+    return (static_cast<size_t>(k) << 2) | (entails ? 2 : 0) | (assume_consistent ? 1 : 0);
   }
 
+  // Res() substitutes for a free variable x every name the sphere or phi
+  // mentions plus one fresh name, which represents all other names: the
+  // sphere cannot tell them apart. The results for the names are grouped, so
+  // that the formula has one conjunct per distinct result. The results of
+  // the sphere's Solver for the ground formulas are memoized in the sphere's
+  // ResMemo, see there.
   template<typename BinaryPredicate>
-  Formula::Ref Res(sphere_index p, Formula::Ref phi, SortedTermSet* names, BinaryPredicate if_no_free_vars) {
+  Formula::Ref Res(sphere_index p, Formula::Ref phi, size_t query, BinaryPredicate if_no_free_vars) {
+    ResMemo* memo = &memos_[p];
+    if (!memo->names) {
+      memo->names = internal::Just(SphereNames(p));
+    }
     if (phi->free_vars().empty()) {
+      ResMemo::Key key{query, Canonical(memo, *phi)};
+      auto it = memo->results.find(key);
+      if (it != memo->results.end()) {
+        return bool_to_formula(it->second);
+      }
+      if (Cancelled(p)) {
+        return bool_to_formula(false);
+      }
       const bool r = if_no_free_vars(&spheres_[p], *phi);
+      memo->results.emplace(std::move(key), r);
       return bool_to_formula(r);
     }
-    Term x = *phi->free_vars().begin();
-    Formula::Ref psi = ResOtherName(p, phi->Clone(), x, names, if_no_free_vars);
-    for (Term n : (*names)[x.sort()]) {
-      Formula::Ref xi = ResName(p, phi->Clone(), x, n, names, if_no_free_vars);
-      psi = Formula::Factory::Not(Formula::Factory::Or(Formula::Factory::Not(std::move(xi)),
-                                                       Formula::Factory::Not(std::move(psi))));
+    const Term x = *phi->free_vars().begin();
+    TermSet ns = memo->names.val[x.sort()];
+    phi->Traverse([x, &ns](Term t) { if (t.name() && t.sort() == x.sort()) ns.insert(t); return true; });
+    Formula::Ref psi = ResOtherName(p, phi->Clone(), x, ns, query, if_no_free_vars);
+    std::vector<std::pair<Formula::Ref, std::vector<Term>>> groups;
+    for (const Term n : ns) {
+      Formula::Ref xi = phi->Clone();
+      xi->SubstituteFree(Term::Substitution(x, n), tf_);
+      xi = Res(p, std::move(xi), query, if_no_free_vars);
+      auto it = std::find_if(groups.begin(), groups.end(), [&xi](const std::pair<Formula::Ref, std::vector<Term>>& g) {
+        return *g.first == *xi;
+      });
+      if (it != groups.end()) {
+        it->second.push_back(n);
+      } else {
+        groups.emplace_back(std::move(xi), std::vector<Term>{n});
+      }
+    }
+    for (auto& g : groups) {
+      // (x == n1 || ... || x == nK -> RES(p, phi^x_n1)) in clausal form
+      if (g.first->trivially_valid()) {
+        continue;
+      }
+      const auto if_not = internal::transform_range(g.second.begin(), g.second.end(),
+                                                    [x](Term n) { return Literal::Eq(x, n); });
+      Formula::Ref xi = Formula::Factory::Not(Formula::Factory::Atomic(Clause(g.second.size(), if_not.begin(),
+                                                                              if_not.end())));
+      if (!g.first->trivially_invalid()) {
+        xi = Formula::Factory::Or(std::move(xi), std::move(g.first));
+      }
+      psi = psi->trivially_valid() ? std::move(xi) :
+          Formula::Factory::Not(Formula::Factory::Or(Formula::Factory::Not(std::move(xi)),
+                                                     Formula::Factory::Not(std::move(psi))));
     }
     return psi;
   }
 
-  template<typename BinaryPredicate>
-  Formula::Ref ResName(sphere_index p,
-                       Formula::Ref phi,
-                       Term x,
-                       Term n,
-                       SortedTermSet* names,
-                       BinaryPredicate if_no_free_vars) {
-    // (x == n -> RES(p, phi^x_n)) in clausal form
-    phi->SubstituteFree(Term::Substitution(x, n), tf_);
-    phi = Res(p, std::move(phi), names, if_no_free_vars);
-    Literal if_not = Literal::Neq(x, n);
-    return Formula::Factory::Or(Formula::Factory::Atomic(Clause(if_not)), std::move(phi));
-  }
-
   template<typename BinaryPredicate>
   Formula::Ref ResOtherName(sphere_index p,
                             Formula::Ref phi,
                             Term x,
-                            SortedTermSet* names,
+                            const TermSet& ns,
+                            size_t query,
                             BinaryPredicate if_no_free_vars) {
     // (x != n1 && ... && x != nK -> RES(p, phi^x_n0)^n0_x) in clausal form
     Term n0 = spheres_[p].grounder()->CreateName(x.sort());
     phi->SubstituteFree(Term::Substitution(x, n0), tf_);
-    names->insert(n0);
-    phi = Res(p, std::move(phi), names, if_no_free_vars);
-    names->erase(n0);
+    phi = Res(p, std::move(phi), query, if_no_free_vars);
     phi->SubstituteFree(Term::Substitution(n0, x), tf_);
     spheres_[p].grounder()->ReturnName(n0);
-    const TermSet& ns = (*names)[x.sort()];
+    if (phi->trivially_valid()) {
+      return phi;
+    }
     const auto if_not = internal::transform_range(ns.begin(), ns.end(), [x](Term n) { return Literal::Eq(x, n); });
     const Clause c(ns.size(), if_not.begin(), if_not.end());
     return Formula::Factory::Or(Formula::Factory::Atomic(c), std::move(phi));
   }
 
+  // The names mentioned by the clauses of the sphere, including the knowledge.
+  SortedTermSet SphereNames(sphere_index p) {
+    SortedTermSet names;
+    auto add = [&names](Term t) { if (t.name()) names.insert(t); return true; };
+    for (const Clause& c : knowledge_) {
+      c.Traverse(add);
+    }
+    for (const Clause& c : spheres_[p].grounder()->clauses()) {
+      c.Traverse(add);
+    }
+    return names;
+  }
+
+  // Replaces the names in phi which the sphere does not mention by the
+  // memo's placeholders, in the order of their first occurrence in phi.
+  Formula::Ref Canonical(ResMemo* memo, const Formula& phi) {
+    std::unordered_map<Term, Term> placeholders;
+    internal::IntMap<Symbol::Sort, size_t> n_placeholders;
+    phi.Traverse([this, memo, &placeholders, &n_placeholders](Term t) {
+      if (t.name() && !memo->names.val.contains(t) && placeholders.find(t) == placeholders.end()) {
+        std::vector<Term>& ps = memo->placeholders[t.sort()];
+        const size_t i = n_placeholders[t.sort()]++;
+        if (i == ps.size()) {
+          ps.push_back(tf_->CreateTerm(sf_->CreateName(t.sort())));
+        }
+        placeholders.emplace(t, ps[i]);
+      }
+      return true;
+    });
+    Formula::Ref psi = phi.Clone();
+    if (!placeholders.empty()) {
+      psi->SubstituteFree([&placeholders](Term t) -> internal::Maybe<Term> {
+        auto it = placeholders.find(t);
+        return it != placeholders.end() ? internal::Just(it->second) : internal::Nothing;
+      }, tf_);
+    }
+    return psi;
+  }
+
   static Formula::Ref bool_to_formula(bool b) {
     Formula::Ref falsum = Formula::Factory::Atomic(Clause());
     return b ? Formula::Factory::Not(std::move(falsum)) : std::move(falsum);
@@ -344,10 +653,25 @@ class KnowledgeBase {
   Term::Factory* tf_;
   std::vector<Clause> knowledge_;
   std::vector<Conditional> beliefs_;
-  SortedTermSet names_;
+  std::unique_ptr<Grounder> base_;
   std::vector<Solver> spheres_;
+  std::unique_ptr<internal::ThreadPool> pool_;
+  // The index of the last relevant sphere while ResBelInParallel() runs.
+  const std::atomic<sphere_index>* last_sphere_ = nullptr;
+  std::vector<ResMemo> memos_;
   Solver objective_;
   bool spheres_changed_ = false;
+  bool incremental_spheres_ = false;
+  // The index of the sphere of each conditional, if any, as of the last build,
+  // which had n_knowledge_ clauses of knowledge.
+  std::vector<internal::Maybe<sphere_index>> ranks_;
+  size_t n_knowledge_ = 0;
+  bool plausibility_consistent_ = true;
+  // The function symbols are connected when they occur in a clause of the
+  // knowledge or in a conditional. Every symbol has a node in a union-find
+  // forest, where components_ holds the parent of every node.
+  std::unordered_map<Symbol, size_t> nodes_;
+  std::vector<size_t> components_;
 };
 
 }  // namespace limbo
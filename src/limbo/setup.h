@@ -5,7 +5,9 @@
 // Setups are collections of primitive clauses, which are added with
 // AddClause() and AddUnit(), where the former is more lightweight.
 // A setup is not automatically minimal wrt unit propagation and subsumption;
-// to ensure minimality, call Minimize().
+// to ensure minimality, call Minimize(). Minimize() is incremental: it only
+// processes the clauses added since its last call and the old clauses which
+// share a term with them or with new unit clauses.
 //
 // The typical lifecycle is to create a Setup object, use AddClause() to
 // populate it, evaluate queries with Subsumes(), Determines(), Consistent(),
@@ -46,14 +48,59 @@
 // since no clause added with AddClause() or AddUnit() is deleted during unit
 // propagation, backtracking can be implemented very cheaply: we just need to
 // adjust the pointers the last unit clause and the last clause to remove all
-// clauses that were added after the point we want to backtrack to. Note that
-// the watched literals may have been adjusted after this point; however, they
-// in particular satisfy their invariant of not being subsumed by any unit
-// clause at this earlier point, so we do not need to adjust them.
+// clauses that were added after the point we want to backtrack to.
+//
+// To avoid testing every clause when a unit is propagated, each term is mapped
+// to the clauses that watch a literal with this term on the left-hand side.
+// Since a literal only reacts with literals of the same left-hand side, only
+// these clauses need to be inspected, so the cost of propagating a unit does
+// not depend on the size of the setup. The same lists serve Subsumes(): as the
+// watched literals of a clause survive unit propagation, a clause can only
+// subsume the query clause if it is listed for one of the query's terms.
+// Changes of the watched literals and of these occurrence lists are recorded
+// in a trail, which is rewound when a ShallowCopy dies, so that the lists stay
+// in sync with the watched literals.
+//
+// fingerprint() is a Zobrist-style hash of the unit clauses added with
+// AddUnit() that were not subsumed already. It is the XOR of a hash of each
+// such unit, so it is maintained incrementally and restored by ShallowCopy,
+// and it does not depend on the order in which the units were added. Since
+// the result of unit propagation does not depend on that order either, two
+// consistent shallow copies of the same setup with equal fingerprints are
+// equivalent (unless the hashes collide, which is very unlikely for 64 bits).
+// Hence the effect of AddUnit(a) can be looked up by fingerprint() ^
+// Fingerprint(a) before a is actually added, provided a is not subsumed.
+//
+// Units added through a ShallowCopy are decisions, and Setup records for each
+// unit propagated from them the clause it was propagated from. When a decision
+// leads to the empty clause, these reasons are traced back to the decisions
+// that caused the conflict, which form a nogood. Subsequent decisions that
+// complete a nogood, that is, whose other decisions are subsumed by units, are
+// inconsistent without unit propagation. Since a nogood is derived from the
+// clauses alone by unit propagation and unit propagation is monotonic, this
+// does not change the result of AddUnit(), only its cost. So the nogoods are
+// kept when the ShallowCopy dies, and even across Minimize() and AddClause(),
+// which only strengthen unit propagation. Nogood learning can be switched off
+// with set_learn_nogoods(). Note that a refuted decision is not propagated,
+// so the setup then has fewer units than after a conflict found by unit
+// propagation; callers which inspect the units of an inconsistent setup pass
+// use_nogoods = false to ShallowCopy::AddUnit().
+//
+// ShallowCopy::AddClause() adds a clause only temporarily: it is removed
+// again when the ShallowCopy dies, as are the units propagated from it. This
+// is useful for clauses that are needed for a single query only. As nogoods
+// learned with such a clause in the setup might not hold without it, no
+// nogoods are learned while temporary clauses are present.
 //
 // The copy constructor and assignment operators are deleted, not for technical
 // reasons, but because it may likely lead to complications with the linked
-// structure of setups and therefore hints at a programming error.
+// structure of setups and therefore hints at a programming error. Copy()
+// makes an explicit deep copy. Overlay() makes a setup that has its own units
+// and watched literals but reads the clauses, their occurrence lists, and the
+// nogoods from the original, which must not change while the overlay lives.
+// As these are the bulk of a setup, overlays are a cheap way to give every
+// thread its own setup to backtrack on. Minimize() must not be called on an
+// overlay.
 
 #ifndef LIMBO_SETUP_H_
 #define LIMBO_SETUP_H_
@@ -61,6 +108,8 @@
 #include <cassert>
 
 #include <algorithm>
+#include <array>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -69,6 +118,7 @@
 #include <limbo/literal.h>
 #include <limbo/term.h>
 
+#include <limbo/internal/hash.h>
 #include <limbo/internal/ints.h>
 #include <limbo/internal/iter.h>
 #include <limbo/internal/maybe.h>
@@ -93,13 +143,18 @@ class Setup {
     const Setup* operator->() const { return setup_; }
     const Setup& operator*() const { return *setup_; }
 
-    Result AddUnit(Literal a) { return setup_->AddUnit(a); }
+    Result AddUnit(Literal a, bool use_nogoods = true) { return setup_->AddUnit(a, true, use_nogoods); }
+    Result AddClause(const Clause& c) { return setup_->AddTemporaryClause(c); }
 
     void Die() {
       if (setup_) {
         assert(setup_->saved_-- > 0);
         setup_->empty_clause_ = empty_clause_;
+        setup_->temporary_clauses_ = temporary_clauses_;
+        setup_->fingerprint_ = fingerprint_;
         setup_->units_.Resize(n_units_);
+        setup_->reasons_.resize(n_units_);
+        setup_->clauses_.Undo(n_trail_);
         setup_->clauses_.Resize(n_clauses_);
         setup_ = nullptr;
       }
@@ -111,53 +166,131 @@ class Setup {
     explicit ShallowCopy(Setup* s) :
       setup_(s),
       empty_clause_(s->empty_clause_),
+      temporary_clauses_(s->temporary_clauses_),
+      fingerprint_(s->fingerprint_),
       n_clauses_(s->clauses_.size()),
-      n_units_(s->units_.size()) {
+      n_units_(s->units_.size()),
+      n_trail_(s->clauses_.trail_size()) {
       assert(++setup_->saved_ > 0);
     }
 
     Setup* setup_;
     bool empty_clause_;
+    bool temporary_clauses_;
+    internal::hash64_t fingerprint_;
     size_t n_clauses_;
     size_t n_units_;
+    size_t n_trail_;
   };
 
   Setup() = default;
-  Setup(const Setup&) = delete;
   Setup& operator=(const Setup&) = delete;
   Setup(Setup&&) = default;
   Setup& operator=(Setup&&) = default;
 
   ShallowCopy shallow_copy() const { return ShallowCopy(const_cast<Setup*>(this)); }
 
+  Setup Copy() const {
+    Setup s(*this);
+#ifndef NDEBUG
+    s.saved_ = 0;
+#endif
+    return s;
+  }
+
+  Setup Overlay() const {
+    Setup s;
+    s.empty_clause_ = empty_clause_;
+    s.temporary_clauses_ = temporary_clauses_;
+    s.fingerprint_ = fingerprint_;
+    s.n_min_units_ = n_min_units_;
+    s.n_min_clauses_ = n_min_clauses_;
+    s.units_ = units_;
+    s.clauses_ = clauses_.Overlay();
+    s.reasons_ = reasons_;
+    s.nogoods_ = nogoods_.Overlay();
+    s.learn_nogoods_ = learn_nogoods_;
+    return s;
+  }
+
   void Minimize() {
     assert(saved_ == 0);
     if (empty_clause_) {
       clauses_.Resize(0);
+      clauses_.Reindex();
       units_.Resize(0);
+      reasons_.clear();
+      n_min_units_ = 0;
+      n_min_clauses_ = 0;
       return;
     }
-    for (size_t i = 0; i < units_.size(); ++i) {
-      Literal a = units_[i];
-      if (!a.pos()) {
-        units_.Erase(i);
-        Result r = units_.Add(a);
-        assert(r != kInconsistent), (void) r;
+    // Only what was added since the last call of Minimize() is processed:
+    // negative units can only be subsumed by new positive units, and clauses
+    // can only be affected if they are new or mention a term of the new units
+    // or clauses.
+    std::vector<Term> new_pos_lhs;
+    std::vector<Term> new_lhs;
+    for (size_t i = n_min_units_; i < units_.size(); ++i) {
+      if (units_[i].pos()) {
+        new_pos_lhs.push_back(units_[i].lhs());
       }
+      new_lhs.push_back(units_[i].lhs());
     }
-    for (size_t i = clauses_.size(); i > 0; --i) {
-      Clause c;
-      std::swap(c, clauses_[i - 1]);
+    if (!new_pos_lhs.empty()) {
+      std::sort(new_pos_lhs.begin(), new_pos_lhs.end());
+      units_.UnsealOriginalUnits();
+      for (size_t i = units_.size(); i > 0; --i) {
+        const Literal a = units_[i - 1];
+        if (!a.pos() && std::binary_search(new_pos_lhs.begin(), new_pos_lhs.end(), a.lhs())) {
+          units_.Erase(i - 1);
+          Result r = units_.Add(a);
+          assert(r != kInconsistent), (void) r;
+        }
+      }
+    }
+    const size_t n_unit_lhs = new_lhs.size();
+    std::vector<size_t> cands;
+    for (size_t i = n_min_clauses_; i < clauses_.size(); ++i) {
+      Clause c = clauses_[i];
+      c.PropagateUnits(units_.set());
+      if (!c.empty()) {
+        new_lhs.push_back(c.first().lhs());
+      }
+      cands.push_back(i);
+    }
+    // New units may shrink old clauses, which then may subsume further ones.
+    for (size_t k = 0; k < new_lhs.size(); ++k) {
+      clauses_.ForEachOccurrence(new_lhs[k], n_min_clauses_, [&](size_t i) {
+        cands.push_back(i);
+        if (k < n_unit_lhs) {
+          Clause c = clauses_[i];
+          const size_t n = c.size();
+          c.PropagateUnits(units_.set());
+          if (!c.empty() && c.size() < n) {
+            new_lhs.push_back(c.first().lhs());
+          }
+        }
+      });
+    }
+    std::sort(cands.begin(), cands.end());
+    cands.erase(std::unique(cands.begin(), cands.end()), cands.end());
+    for (auto it = cands.rbegin(); it != cands.rend(); ++it) {
+      const size_t i = *it;
+      Clause c = clauses_.Take(i);
       c.PropagateUnits(units_.set());
       assert(!c.empty());
       assert(c.size() >= 2 ||
              any_of(units_.vec().begin(), units_.vec().end(), [&c](Literal a) { return a.Subsumes(c.first()); }));
-      clauses_.Erase(i - 1);
+      clauses_.Erase(i);
       if (c.size() >= 2 && !Subsumes(c)) {
         clauses_.Add(c);
       }
     }
+    clauses_.ClearTrail();
     units_.SealOriginalUnits();  // units_.set() have been eliminated from all clauses, so not needed in AddUnit()
+    reasons_.assign(units_.size(), kFact);
+    n_min_units_ = units_.size();
+    n_min_clauses_ = clauses_.size();
   }
 
   Result AddClause(Clause c) {
@@ -179,36 +312,7 @@ class Setup {
     }
   }
 
-  Result AddUnit(Literal a) {
-    assert(a.primitive());
-    assert(!a.valid() && !a.invalid());
-    if (empty_clause_) {
-      return kInconsistent;
-    }
-    size_t n_propagated = units_.size();
-    Result r = units_.Add(a);
-    empty_clause_ = r == kInconsistent;
-    for (; n_propagated < units_.size() && r != kInconsistent; ++n_propagated) {
-      a = units_[n_propagated];
-      for (size_t i = 0; i < clauses_.size() && r != kInconsistent; ++i) {
-        if (Literal::Complementary(clauses_.watched(i).a, a) ||
-            Literal::Complementary(clauses_.watched(i).b, a)) {
-          Clause c = clauses_[i];
-          c.PropagateUnits(units_.set());
-          if (c.size() == 0) {
-            r = kInconsistent;
-            empty_clause_ = true;
-          } else if (c.size() == 1) {
-            r = units_.Add(c.first());
-            empty_clause_ = r == kInconsistent;
-          } else {
-            clauses_.Watch(i, c.first(), c.last());
-          }
-        }
-      }
-    }
-    return r;
-  }
+  Result AddUnit(Literal a) { return AddUnit(a, false, false); }
 
   bool Subsumes(const Clause& c) const {
     assert(c.ground());
@@ -221,10 +325,8 @@ class Setup {
     if (!c.primitive()) {
       return c.valid();
     }
-    for (size_t i = 0; i < units_.size(); ++i) {
-      if (Clause::Subsumes(units_[i], c)) {
-        return true;
-      }
+    if (std::any_of(c.begin(), c.end(), [this](Literal a) { return units_.Subsumes(a); })) {
+      return true;
     }
     if (c.unit() && c.first().pos()) {
       return false;
@@ -268,6 +370,13 @@ class Setup {
 
   bool contains_empty_clause() const { return empty_clause_; }
 
+  void set_learn_nogoods(bool b) { learn_nogoods_ = b; }
+  size_t n_nogoods() const { return nogoods_.size(); }
+
+  internal::hash64_t fingerprint() const { return fingerprint_; }
+
+  static internal::hash64_t Fingerprint(Literal a) { return internal::murmur64a_hash(a); }
+
   const std::vector<Literal>& units() const { return units_.vec(); }
 
   internal::Maybe<Term> Determines(Term lhs) const {
@@ -285,6 +394,18 @@ class Setup {
 
   ClauseRange clauses() const { return ClauseRange(*this); }
 
+  // Calls f(i) for every i in clauses() such that clause(i) may mention a
+  // literal whose left-hand side is t, possibly more than once. The clauses
+  // are looked up in the occurrence index instead of being iterated, and
+  // clause(i) may not mention t anymore due to unit propagation.
+  template<typename UnaryFunction>
+  void ForEachClauseMentioning(Term t, UnaryFunction f) const {
+    const size_t n_empty = empty_clause_ ? 1 : 0;
+    const size_t n_units = units_.size();
+    units_.ForEachOccurrence(t, [n_empty, &f](size_t i) { f(n_empty + i); });
+    clauses_.ForEachOccurrence(t, clauses_.size(), [n_empty, n_units, &f](size_t i) { f(n_empty + n_units + i); });
+  }
+
   Clause clause(size_t i) const {
     if (i == 0 && empty_clause_) {
       return Clause();
@@ -302,6 +423,8 @@ class Setup {
  private:
   friend ShallowCopy;
 
+  Setup(const Setup&) = default;
+
   struct Watched {
     Watched() = default;
     Watched(Literal a, Literal b) : a(a), b(b) { assert(a < b); }
@@ -312,48 +435,208 @@ class Setup {
 
   class Clauses {
    public:
-    const Clause& operator[](size_t i) const { return clauses_[i]; }
-    Clause& operator[](size_t i) { return clauses_[i]; }
+    Clauses() = default;
+
+    // Returns clauses which read the first size() clauses and their
+    // occurrence lists from this object, which must not change until the
+    // overlay dies, and only store the watched literals and what is added
+    // to the overlay.
+    Clauses Overlay() const {
+      assert(!base_);
+      Clauses cs;
+      cs.base_ = this;
+      cs.n_base_ = clauses_.size();
+      cs.watched_ = watched_;
+      return cs;
+    }
+
+    const Clause& operator[](size_t i) const { return i < n_base_ ? base_->clauses_[i] : clauses_[i - n_base_]; }
+
+    // Moves clause i out, leaving the empty clause in its place.
+    Clause Take(size_t i) {
+      assert(!base_);
+      Clause c;
+      std::swap(c, clauses_[i]);
+      return c;
+    }
 
     Watched watched(size_t i) const { return watched_[i]; }
-    Watched& watched(size_t i) { return watched_[i]; }
+
+    // Returns the lists of clauses which watch a literal whose left-hand side
+    // is t in the base of an overlay and in this object, or nullptr if there
+    // are none. The lists may contain clauses which watched such a literal at
+    // some earlier point as well as indices of clauses that have been erased
+    // since; they are removed by Reindex().
+    std::array<const std::vector<size_t>*, 2> watchers(Term t) const {
+      std::array<const std::vector<size_t>*, 2> occs{{nullptr, nullptr}};
+      if (base_) {
+        auto it = base_->watchers_.find(t);
+        occs[0] = it != base_->watchers_.end() ? &it->second : nullptr;
+      }
+      auto it = watchers_.find(t);
+      occs[1] = it != watchers_.end() ? &it->second : nullptr;
+      return occs;
+    }
+
+    // Calls f(i) for every clause i < n which mentions a literal whose
+    // left-hand side is t, possibly more than once.
+    template<typename UnaryFunction>
+    void ForEachOccurrence(Term t, size_t n, UnaryFunction f) const {
+      auto g = [this, t, n, &f](size_t i) {
+        if (i < n && i < size() &&
+            std::any_of((*this)[i].begin(), (*this)[i].end(), [t](Literal a) { return a.lhs() == t; })) {
+          f(i);
+        }
+      };
+      if (base_) {
+        auto it = base_->occurrences_.find(t);
+        if (it != base_->occurrences_.end()) {
+          std::for_each(it->second.begin(), it->second.end(), g);
+        }
+      }
+      auto it = occurrences_.find(t);
+      if (it != occurrences_.end()) {
+        std::for_each(it->second.begin(), it->second.end(), g);
+      }
+    }
 
     void Add(const Clause& c) {
       assert(c.size() >= 2);
       watched_.push_back(Watched(c.first(), c.last()));
       clauses_.push_back(c);
+      Occur(size() - 1, watched_.back(), Watched());
+      Index(size() - 1);
     }
 
     void Add(Clause&& c) {
       assert(c.size() >= 2);
       watched_.push_back(Watched(c.first(), c.last()));
       clauses_.push_back(std::forward<Clause>(c));
+      Occur(size() - 1, watched_.back(), Watched());
+      Index(size() - 1);
     }
 
     void Watch(size_t i, Literal a, Literal b) {
       assert(a < b);
+      const Watched old = watched_[i];
+      trail_.push_back(TrailEntry{i, old, Term(), false});
       watched_[i] = Watched(a, b);
+      Occur(i, watched_[i], old);
     }
 
     size_t size() const {
-      assert(clauses_.size() == watched_.size());
-      return clauses_.size();
+      assert(n_base_ + clauses_.size() == watched_.size());
+      return watched_.size();
     }
 
     void Erase(size_t i) {
+      assert(!base_);
       std::swap(clauses_[i], clauses_.back());
       std::swap(watched_[i], watched_.back());
       Resize(clauses_.size() - 1);
+      if (i < clauses_.size()) {
+        Occur(i, watched_[i], Watched());
+        Index(i);
+      }
+      ++n_stale_;
     }
 
     void Resize(size_t n) {
-      clauses_.resize(n);
+      assert(n >= n_base_);
+      clauses_.resize(n - n_base_);
       watched_.resize(n);
     }
 
+    size_t trail_size() const { return trail_.size(); }
+
+    // Undoes all calls of Add() and Watch() since the trail had size n.
+    void Undo(size_t n) {
+      while (trail_.size() > n) {
+        const TrailEntry& e = trail_.back();
+        if (!e.occ.null()) {
+          std::vector<size_t>& occs = e.indexed ? occurrences_[e.occ] : watchers_[e.occ];
+          assert(!occs.empty() && occs.back() == e.index);
+          occs.pop_back();
+        } else {
+          watched_[e.index] = e.watched;
+        }
+        trail_.pop_back();
+      }
+    }
+
+    // Rebuilds the occurrence lists from scratch, which drops stale entries.
+    // Must not be called while the trail is needed by a ShallowCopy.
+    void Reindex() {
+      assert(!base_);
+      watchers_.clear();
+      occurrences_.clear();
+      for (size_t i = 0; i < watched_.size(); ++i) {
+        Occur(i, watched_[i], Watched());
+        Index(i);
+      }
+      trail_.clear();
+      n_stale_ = 0;
+    }
+
+    // Discards the trail and calls Reindex() when the occurrence lists have
+    // accumulated more stale entries than there are clauses. Must not be
+    // called while the trail is needed by a ShallowCopy.
+    void ClearTrail() {
+      assert(!base_);
+      n_stale_ += std::count_if(trail_.begin(), trail_.end(), [](const TrailEntry& e) { return !e.indexed; });
+      trail_.clear();
+      if (n_stale_ > clauses_.size()) {
+        Reindex();
+      }
+    }
+
    private:
+    // A trail entry either records the previous watched literals of a clause
+    // (occ is null) or that the clause was appended to the list of occ in
+    // watchers_ or, if indexed, in occurrences_.
+    struct TrailEntry {
+      size_t index;
+      Watched watched;
+      Term occ;
+      bool indexed;
+    };
+
+    void Occur(size_t i, Watched w, Watched old) {
+      Occur(i, w.a.lhs(), old);
+      if (w.b.lhs() != w.a.lhs()) {
+        Occur(i, w.b.lhs(), old);
+      }
+    }
+
+    void Occur(size_t i, Term t, Watched old) {
+      if (!old.a.null() && (old.a.lhs() == t || old.b.lhs() == t)) {
+        return;
+      }
+      std::vector<size_t>& occs = watchers_[t];
+      if (occs.empty() || occs.back() != i) {
+        occs.push_back(i);
+        trail_.push_back(TrailEntry{i, Watched(), t, false});
+      }
+    }
+
+    void Index(size_t i) {
+      const Clause& c = (*this)[i];
+      for (size_t k = 0; k < c.size(); ++k) {
+        if (k == 0 || c[k - 1].lhs() != c[k].lhs()) {
+          occurrences_[c[k].lhs()].push_back(i);
+          trail_.push_back(TrailEntry{i, Watched(), c[k].lhs(), true});
+        }
+      }
+    }
+
+    const Clauses* base_ = nullptr;
+    size_t n_base_ = 0;
     std::vector<Clause> clauses_;
     std::vector<Watched> watched_;
+    std::unordered_map<Term, std::vector<size_t>> watchers_;
+    std::unordered_map<Term, std::vector<size_t>> occurrences_;
+    std::vector<TrailEntry> trail_;
+    size_t n_stale_ = 0;
   };
 
   class Units {
@@ -443,6 +726,40 @@ class Setup {
       return internal::Nothing;
     }
 
+    bool Subsumes(Literal b) const {
+      auto orig_end = vec_.begin() + n_orig_;
+      auto orig_begin = std::lower_bound(vec_.begin(), orig_end, Literal::Min(b.lhs()));
+      for (auto it = orig_begin; it != orig_end && b.lhs() == it->lhs(); ++it) {
+        if (it->Subsumes(b)) {
+          return true;
+        }
+      }
+      if (set_.bucket_count() > 0) {
+        auto bucket = set_.bucket(b);
+        for (auto it = set_.begin(bucket), end = set_.end(bucket); it != end; ++it) {
+          if (it->Subsumes(b)) {
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
+    // Calls f(i) for every unit i whose left-hand side is t. The original
+    // units are sorted, so only the ones added since are scanned.
+    template<typename UnaryFunction>
+    void ForEachOccurrence(Term t, UnaryFunction f) const {
+      auto orig_end = vec_.begin() + n_orig_;
+      for (auto it = std::lower_bound(vec_.begin(), orig_end, Literal::Min(t)); it != orig_end && t == it->lhs(); ++it) {
+        f(it - vec_.begin());
+      }
+      for (size_t i = n_orig_; i < vec_.size(); ++i) {
+        if (vec_[i].lhs() == t) {
+          f(i);
+        }
+      }
+    }
+
     const std::vector<Literal>&                          vec() const { return vec_; }
     const std::unordered_set<Literal, Literal::LhsHash>& set() const { return set_; }
 
@@ -452,14 +769,383 @@ class Setup {
     size_t n_orig_ = 0;
   };
 
+  // DenseUnits is an alternative to Units which is enabled with DENSE_UNITS.
+  // Instead of hashing, it uses Term::index() of the left-hand side to look up
+  // the unit clauses in a flat array, where each slot stores the name the
+  // term is determined to be equal to (if any) and a linked list of the names
+  // the term is determined to be distinct from. Add(), Determines(), and the
+  // Complementary() test used by Clause::PropagateUnits() hence are array
+  // probes. The order of the units in vec_ serves as trail for Resize().
+  class DenseUnits {
+   public:
+    Literal operator[](size_t i) const { return vec_[i]; }
+
+    size_t size() const { return vec_.size(); }
+
+    Result Add(Literal a) {
+      assert(a.primitive());
+      Slot& s = slot(a.lhs());
+      if (!s.eq.null()) {
+        return (a.pos() ? s.eq == a.rhs() : s.eq != a.rhs()) ? kSubsumed : kInconsistent;
+      }
+      if (Excludes(s, a.rhs())) {
+        return a.pos() ? kInconsistent : kSubsumed;
+      }
+      if (a.pos()) {
+        s.eq = a.rhs();
+      } else {
+        neqs_.push_back(Neq{a.rhs(), s.neq});
+        s.neq = neqs_.size();
+      }
+      vec_.push_back(a);
+      return kOk;
+    }
+
+    void Resize(size_t n) {
+      assert(n >= n_orig_);
+      while (vec_.size() > n) {
+        Remove(vec_.back());
+        vec_.pop_back();
+      }
+    }
+
+    void Erase(size_t i) {
+      assert(n_orig_ == 0);
+      Remove(vec_[i]);
+      std::swap(vec_[i], vec_.back());
+      vec_.pop_back();
+    }
+
+    void SealOriginalUnits() {
+      // Erase() may have left unreachable entries in neqs_, so we rebuild it.
+      std::vector<Literal> vec;
+      std::swap(vec, vec_);
+      std::sort(vec.begin(), vec.end());
+      slots_.clear();
+      neqs_.clear();
+      for (Literal a : vec) {
+        Result r = Add(a);
+        assert(r != kInconsistent), (void) r;
+      }
+      n_orig_ = vec_.size();
+    }
+
+    void UnsealOriginalUnits() { n_orig_ = 0; }
+
+    internal::Maybe<Term> Determines(Term t) const {
+      assert(t.primitive());
+      const Slot* s = find(t);
+      return s && !s->eq.null() ? internal::Just(s->eq) : internal::Nothing;
+    }
+
+    bool Subsumes(Literal b) const {
+      assert(b.primitive());
+      const Slot* s = find(b.lhs());
+      if (!s) {
+        return false;
+      }
+      if (b.pos()) {
+        return s->eq == b.rhs();
+      }
+      return (!s->eq.null() && s->eq != b.rhs()) || Excludes(*s, b.rhs());
+    }
+
+    bool Complementary(Literal a) const { return Subsumes(a.flip()); }
+
+    // Calls f(i) for every unit i whose left-hand side is t. As in Units,
+    // the original units are sorted, so only the ones added since are scanned.
+    template<typename UnaryFunction>
+    void ForEachOccurrence(Term t, UnaryFunction f) const {
+      auto orig_end = vec_.begin() + n_orig_;
+      for (auto it = std::lower_bound(vec_.begin(), orig_end, Literal::Min(t)); it != orig_end && t == it->lhs(); ++it) {
+        f(it - vec_.begin());
+      }
+      for (size_t i = n_orig_; i < vec_.size(); ++i) {
+        if (vec_[i].lhs() == t) {
+          f(i);
+        }
+      }
+    }
+
+
+    const std::vector<Literal>& vec() const { return vec_; }
+    const DenseUnits&           set() const { return *this; }
+
+   private:
+    struct Slot {
+      Term eq;
+      size_t neq = 0;
+    };
+
+    struct Neq {
+      Term name;
+      size_t next;
+    };
+
+    Slot& slot(Term t) {
+      if (t.index() >= slots_.size()) {
+        slots_.resize(t.index() + 1);
+      }
+      return slots_[t.index()];
+    }
+
+    const Slot* find(Term t) const { return t.index() < slots_.size() ? &slots_[t.index()] : nullptr; }
+
+    bool Excludes(const Slot& s, Term n) const {
+      for (size_t i = s.neq; i != 0; i = neqs_[i - 1].next) {
+        if (neqs_[i - 1].name == n) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void Remove(Literal a) {
+      Slot& s = slot(a.lhs());
+      if (a.pos()) {
+        assert(s.eq == a.rhs());
+        s.eq = Term();
+        return;
+      }
+      // When the units are removed in reverse order, a is the head of the list.
+      size_t* prev = &s.neq;
+      while (neqs_[*prev - 1].name != a.rhs()) {
+        prev = &neqs_[*prev - 1].next;
+        assert(*prev != 0);
+      }
+      const size_t i = *prev;
+      *prev = neqs_[i - 1].next;
+      if (i == neqs_.size()) {
+        neqs_.pop_back();
+      }
+    }
+
+    std::vector<Literal> vec_;
+    std::vector<Slot> slots_;
+    std::vector<Neq> neqs_;
+    size_t n_orig_ = 0;
+  };
+
+  // The reason of a unit is kFact if it was not added through a ShallowCopy,
+  // kDecision if it was, and otherwise the index of the clause it was
+  // propagated from.
+  enum : size_t { kFact = static_cast<size_t>(-1), kDecision = static_cast<size_t>(-2) };
+
+  static constexpr size_t kMaxNogoods = 1 << 16;
+
+  // Nogoods stores sets of decisions which are inconsistent with the setup.
+  class Nogoods {
+   public:
+    Nogoods() = default;
+
+    // Returns nogoods which also contain those of this object, which must not
+    // change until the overlay dies.
+    Nogoods Overlay() const {
+      assert(!base_);
+      Nogoods ngs;
+      ngs.base_ = this;
+      return ngs;
+    }
+
+    size_t size() const { return (base_ ? base_->size() : 0) + nogoods_.size(); }
+
+    void Add(std::vector<Literal>&& nogood) {
+      for (const Literal a : nogood) {
+        index_[a].push_back(nogoods_.size());
+      }
+      nogoods_.push_back(std::move(nogood));
+    }
+
+    // Returns true if the decision a completes a nogood.
+    template<typename UnitIndex>
+    bool Refutes(Literal a, const UnitIndex& units) const {
+      if (base_ && base_->Refutes(a, units)) {
+        return true;
+      }
+      auto it = index_.find(a);
+      if (it == index_.end()) {
+        return false;
+      }
+      for (const size_t i : it->second) {
+        const std::vector<Literal>& nogood = nogoods_[i];
+        if (std::all_of(nogood.begin(), nogood.end(), [a, &units](Literal b) { return a == b || units.Subsumes(b); })) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+   private:
+    const Nogoods* base_ = nullptr;
+    std::vector<std::vector<Literal>> nogoods_;
+    std::unordered_map<Literal, std::vector<size_t>> index_;
+  };
+
+  Result AddUnit(Literal a, bool decision, bool use_nogoods) {
+    assert(a.primitive());
+    assert(!a.valid() && !a.invalid());
+    if (empty_clause_) {
+      return kInconsistent;
+    }
+    if (decision && use_nogoods && learn_nogoods_ && nogoods_.Refutes(a, units_)) {
+      empty_clause_ = true;
+      return kInconsistent;
+    }
+    size_t n_propagated = units_.size();
+    Result r = units_.Add(a);
+    empty_clause_ = r == kInconsistent;
+    if (r == kOk) {
+      fingerprint_ ^= Fingerprint(a);
+      reasons_.push_back(decision ? kDecision : kFact);
+    } else if (r == kInconsistent && decision) {
+      LearnNogood(a, kDecision);
+    }
+    for (; n_propagated < units_.size() && r != kInconsistent; ++n_propagated) {
+      a = units_[n_propagated];
+      for (const std::vector<size_t>* occs : clauses_.watchers(a.lhs())) {
+        for (size_t j = 0; occs && j < occs->size() && r != kInconsistent; ++j) {
+          const size_t i = (*occs)[j];
+          if (i < clauses_.size() &&
+              (Literal::Complementary(clauses_.watched(i).a, a) ||
+               Literal::Complementary(clauses_.watched(i).b, a))) {
+            Clause c = clauses_[i];
+            c.PropagateUnits(units_.set());
+            if (c.size() == 0) {
+              r = kInconsistent;
+              empty_clause_ = true;
+            } else if (c.size() == 1) {
+              r = units_.Add(c.first());
+              empty_clause_ = r == kInconsistent;
+              if (r == kOk) {
+                reasons_.push_back(decision ? i : kFact);
+              }
+            } else {
+              clauses_.Watch(i, c.first(), c.last());
+            }
+            if (r == kInconsistent && decision) {
+              LearnNogood(Literal(), i);
+            }
+          }
+        }
+      }
+    }
+    assert(reasons_.size() == units_.size());
+    return r;
+  }
+
+  // Unlike AddClause(), this does not unseal the original units, which is why
+  // they are propagated with Subsumes() instead of Clause::PropagateUnits().
+  Result AddTemporaryClause(const Clause& c) {
+    assert(c.primitive());
+    assert(!c.valid());
+    if (empty_clause_) {
+      return kInconsistent;
+    }
+    if (c.any([this](Literal a) { return units_.Subsumes(a); })) {
+      return kSubsumed;
+    }
+    temporary_clauses_ = true;
+    std::vector<Literal> lits;
+    for (const Literal a : c) {
+      if (!units_.Subsumes(a.flip())) {
+        lits.push_back(a);
+      }
+    }
+    if (lits.empty()) {
+      empty_clause_ = true;
+      return kInconsistent;
+    } else if (lits.size() == 1) {
+      return AddUnit(lits.front(), false, false);
+    } else {
+      clauses_.Add(Clause(lits.begin(), lits.end()));
+      return kOk;
+    }
+  }
+
+  // Traces back the conflict of the decision a or the clause with index
+  // reason, whose literals are all complementary to units, to the decisions
+  // that caused it. Each literal is explained by a complementary unit that
+  // was added earlier, and each propagated unit by the other literals of its
+  // reason clause; units which are not due to decisions need no explanation.
+  void LearnNogood(Literal a, size_t reason) {
+    if (!learn_nogoods_ || temporary_clauses_ || nogoods_.size() >= kMaxNogoods) {
+      return;
+    }
+    size_t begin = units_.size();
+    while (begin > 0 && reasons_[begin - 1] != kFact) {
+      --begin;
+    }
+    std::unordered_map<Term, std::vector<size_t>> units_by_lhs;
+    for (size_t i = begin; i < units_.size(); ++i) {
+      units_by_lhs[units_[i].lhs()].push_back(i);
+    }
+    std::vector<bool> marked(units_.size() - begin, false);
+    auto explain = [&](Literal b, size_t end) {
+      auto it = units_by_lhs.find(b.lhs());
+      if (it != units_by_lhs.end()) {
+        for (size_t i = 0; i < it->second.size() && it->second[i] < end; ++i) {
+          if (Literal::Complementary(b, units_[it->second[i]])) {
+            marked[it->second[i] - begin] = true;
+            break;
+          }
+        }
+      }
+    };
+    const Clauses& clauses = clauses_;
+    std::vector<Literal> nogood;
+    if (reason == kDecision) {
+      nogood.push_back(a);
+      explain(a, units_.size());
+    } else {
+      for (const Literal b : clauses[reason]) {
+        explain(b, units_.size());
+      }
+    }
+    for (size_t i = units_.size(); i > begin; --i) {
+      if (!marked[i - 1 - begin]) {
+        continue;
+      }
+      const Literal b = units_[i - 1];
+      if (reasons_[i - 1] == kDecision) {
+        nogood.push_back(b);
+      } else {
+        assert(reasons_[i - 1] != kFact);
+        for (const Literal c : clauses[reasons_[i - 1]]) {
+          if (c != b) {
+            explain(c, i - 1);
+          }
+        }
+      }
+    }
+    if (!nogood.empty()) {
+      nogoods_.Add(std::move(nogood));
+    }
+  }
+
   bool ClausesSubsume(const Clause& d) const {
     assert(d.size() >= 1 && (d.size() >= 2 || !d.first().pos()));
-    for (size_t i = 0; i < clauses_.size(); ++i) {
-      if (Clause::Subsumes(clauses_.watched(i).a, clauses_.watched(i).b, d)) {
-        Clause c = clauses_[i];
-        c.PropagateUnits(units_.set());
-        if (Clause::Subsumes(c, d)) {
-          return true;
+    // A clause can only subsume d if its first watched literal has the same
+    // left-hand side as a literal in d. Looking up the clauses only in the
+    // occurrence list of that term avoids testing a clause more than once.
+    for (size_t k = 0; k < d.size(); ++k) {
+      const Term t = d[k].lhs();
+      if (k > 0 && d[k - 1].lhs() == t) {
+        continue;
+      }
+      for (const std::vector<size_t>* occs : clauses_.watchers(t)) {
+        if (!occs) {
+          continue;
+        }
+        for (const size_t i : *occs) {
+          if (i < clauses_.size() &&
+              clauses_.watched(i).a.lhs() == t &&
+              Clause::Subsumes(clauses_.watched(i).a, clauses_.watched(i).b, d)) {
+            Clause c = clauses_[i];
+            c.PropagateUnits(units_.set());
+            if (Clause::Subsumes(c, d)) {
+              return true;
+            }
+          }
         }
       }
     }
@@ -484,8 +1170,19 @@ class Setup {
   }
 
   bool empty_clause_ = false;
+  bool temporary_clauses_ = false;
+  internal::hash64_t fingerprint_ = 0;
+  size_t n_min_units_ = 0;
+  size_t n_min_clauses_ = 0;
+#ifdef DENSE_UNITS
+  DenseUnits units_;
+#else
   Units units_;
+#endif
   Clauses clauses_;
+  std::vector<size_t> reasons_;
+  Nogoods nogoods_;
+  bool learn_nogoods_ = true;
 #ifndef NDEBUG
   mutable size_t saved_ = 0;
 #endif
@@ -42,14 +42,52 @@
 // EntailsComplete(k, phi)) == !Consistent(k, Not(phi)). The advantage of
 // the Consistent() method is that it is perhaps less confusing and less prone
 // to typos and shares some code with the sound Entails().
+//
+// When the split order matters, the same splits are often reached in
+// different orders, for example, t1 = n1 and then t2 = n2 or vice versa. The
+// result of a subtree of the split search is hence memoized in a transposition
+// table, keyed by the Setup::fingerprint() of the splits, the split level, and
+// the split terms that remain to be split. Since the fingerprint of a split
+// can be computed before the split is done, a hit also saves the unit
+// propagation. The table lives for a single split search, that is, for a fixed
+// goal and a fixed setup, and is bounded by set_transposition_table_size().
+//
+// With set_query_cache_size(), the results of Entails(), Determines(), and
+// Consistent() are cached across queries. A result is keyed by the kind of
+// the query, the split level, the consistency guarantee, and the query term
+// or formula, whose bound variables are renamed canonically, so that
+// alpha-equivalent formulas share an entry. The cache is bounded and evicts
+// the least recently used entry. It is versioned by Grounder::version(),
+// which is checked after PrepareForQuery(); when the clauses, names, or split
+// terms have changed since the results were cached, the cache is cleared.
+//
+// EntailsAll() and DeterminesAll() evaluate many queries at once, for
+// example, one for each cell of a game board. They ground once and search a
+// single split tree, where the goals of all queries are evaluated at every
+// leaf, instead of one split tree per query.
+//
+// EntailsUpTo() and DeterminesUpTo() deepen the split level up to a maximum
+// and report the smallest level at which the query succeeds. They use one
+// transposition table for all levels. Its keys cap the split level at the
+// number of remaining split terms, since more splits do not change the
+// result then. For Entails() a subtree proven at a lower level also counts
+// as proven at a higher one, because entailment is monotonic in the split
+// level.
 
 #ifndef LIMBO_SOLVER_H_
 #define LIMBO_SOLVER_H_
 
 #include <cassert>
 
+#include <atomic>
+#include <chrono>
 #include <iterator>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
 
 #include <limbo/formula.h>
 #include <limbo/grounder.h>
@@ -57,19 +95,25 @@
 #include <limbo/setup.h>
 #include <limbo/term.h>
 
+#include <limbo/internal/hash.h>
+#include <limbo/internal/intmap.h>
 #include <limbo/internal/ints.h>
 #include <limbo/internal/maybe.h>
+#include <limbo/internal/threadpool.h>
 
 namespace limbo {
 
 class Solver {
  public:
   typedef Formula::split_level split_level;
+  typedef std::chrono::steady_clock Clock;
 
   static constexpr bool kConsistencyGuarantee = true;
   static constexpr bool kNoConsistencyGuarantee = false;
 
-  Solver(Symbol::Factory* sf, Term::Factory* tf) : tf_(tf), grounder_(sf, tf) {}
+  static constexpr internal::size_t kDefaultTranspositionTableSize = 1 << 16;
+
+  Solver(Symbol::Factory* sf, Term::Factory* tf) : sf_(sf), tf_(tf), grounder_(sf, tf) {}
   Solver(const Solver&) = delete;
   Solver& operator=(const Solver&) = delete;
   Solver(Solver&&) = default;
@@ -81,22 +125,78 @@ class Solver {
 
   Grounder* grounder() { return &grounder_; }
 
+  // Enables parallel splitting on n_threads threads, including the calling
+  // thread, for queries with split level k >= 2, as well as parallel grounding;
+  // n_threads <= 1 disables it. Only Determines() and the conjuncts of
+  // Entails() that are clauses split in parallel; Consistent(), the batched
+  // and the iterative-deepening queries always split sequentially. The
+  // speedup has not been measured on a multicore machine yet.
+  void set_threads(internal::size_t n_threads) {
+    pool_ = n_threads > 1 ? std::unique_ptr<internal::ThreadPool>(new internal::ThreadPool(n_threads - 1)) : nullptr;
+    grounder_.set_thread_pool(pool_.get());
+  }
+
+  // Bounds the number of memoized subtree results per split search; 0 disables
+  // the transposition table.
+  void set_transposition_table_size(internal::size_t n) { tt_max_size_ = n; }
+
+  internal::size_t transposition_table_hits()   const { return tt_hits_; }
+  internal::size_t transposition_table_misses() const { return tt_misses_; }
+
+  // Bounds the number of cached query results; 0 disables the query cache.
+  void set_query_cache_size(internal::size_t n) {
+    query_cache_max_size_ = n;
+    entails_cache_.Clear();
+    determines_cache_.Clear();
+  }
+
+  internal::size_t query_cache_hits()   const { return query_cache_hits_; }
+  internal::size_t query_cache_misses() const { return query_cache_misses_; }
+
+  // Enables or disables learning nogoods from inconsistent splits, see Setup.
+  void set_learn_nogoods(bool b) { grounder_.set_learn_nogoods(b); }
+
+  // Enables or disables grounding only the clauses relevant to the queries,
+  // see Grounder; meant for queries with consistency guarantee.
+  void set_lazy_grounding(bool b) { grounder_.set_lazy_grounding(b); }
+
   bool Entails(int k, const Formula& phi, bool assume_consistent) {
     assert(phi.objective());
     assert(phi.free_vars().empty());
     grounder_.PrepareForQuery(k, phi);
+    QueryKey key;
+    if (query_cache_max_size_ > 0) {
+      key = QueryKey{kEntailsQuery, k, assume_consistent, Term(), Canonical(phi)};
+      if (const bool* r = FindQuery(&entails_cache_, key)) {
+        grounder_.EndQuery();
+        return *r;
+      }
+    }
     const Setup& s = grounder_.Ground();
     TermSet split_terms =
       k == 0            ? TermSet() :
       assume_consistent ? grounder_.RelevantSplitTerms(phi) :
                           grounder_.SplitTerms();
     const SortedTermSet& names = grounder_.Names();
-    return s.Subsumes(Clause{}) || ReduceConjunctions(s, split_terms, names, k, phi);
+    const bool r = s.Subsumes(Clause{}) || ReduceConjunctions(s, split_terms, names, k, phi);
+    grounder_.EndQuery();
+    if (query_cache_max_size_ > 0) {
+      entails_cache_.Insert(std::move(key), r, query_cache_max_size_);
+    }
+    return r;
   }
 
   internal::Maybe<Term> Determines(int k, Term lhs, bool assume_consistent) {
     assert(lhs.primitive());
     grounder_.PrepareForQuery(k, lhs);
+    QueryKey key;
+    if (query_cache_max_size_ > 0) {
+      key = QueryKey{kDeterminesQuery, k, assume_consistent, lhs, Formula::Ref()};
+      if (const internal::Maybe<Term>* r = FindQuery(&determines_cache_, key)) {
+        grounder_.EndQuery();
+        return *r;
+      }
+    }
     const Setup& s = grounder_.Ground();
     TermSet split_terms =
       k == 0            ? TermSet() :
@@ -105,15 +205,21 @@ class Solver {
     const SortedTermSet& names = grounder_.Names();
     internal::Maybe<Term> inconsistent_result = internal::Just(Term());
     internal::Maybe<Term> unsuccessful_result = internal::Nothing;
-    return Split<true>(s, split_terms, names, k,
-                       [this, &names, lhs](const Setup& s) { return s.Determines(lhs); },
-                       [](internal::Maybe<Term> r1, internal::Maybe<Term> r2) {
-                         return r1 && r2 && r1.val == r2.val ? r1 :
-                                r1 && r2 && r1.val.null()    ? r2 :
-                                r1 && r2 && r2.val.null()    ? r1 :
-                                                               internal::Nothing;
-                       },
-                       inconsistent_result, unsuccessful_result);
+    const internal::Maybe<Term> r =
+        Split<true>(s, split_terms, names, k,
+                    [this, &names, lhs](const Setup& s) { return s.Determines(lhs); },
+                    [](internal::Maybe<Term> r1, internal::Maybe<Term> r2) {
+                      return r1 && r2 && r1.val == r2.val ? r1 :
+                             r1 && r2 && r1.val.null()    ? r2 :
+                             r1 && r2 && r2.val.null()    ? r1 :
+                                                            internal::Nothing;
+                    },
+                    inconsistent_result, unsuccessful_result, true);
+    grounder_.EndQuery();
+    if (query_cache_max_size_ > 0) {
+      determines_cache_.Insert(std::move(key), r, query_cache_max_size_);
+    }
+    return r;
   }
 
   bool EntailsComplete(int k, const Formula& phi, bool assume_consistent) {
@@ -127,6 +233,14 @@ class Solver {
     assert(phi.objective());
     assert(phi.free_vars().empty());
     grounder_.PrepareForQuery(k, phi);
+    QueryKey key;
+    if (query_cache_max_size_ > 0) {
+      key = QueryKey{kConsistentQuery, k, assume_consistent, Term(), Canonical(phi)};
+      if (const bool* r = FindQuery(&entails_cache_, key)) {
+        grounder_.EndQuery();
+        return *r;
+      }
+    }
     const Setup& s = grounder_.Ground();
     LiteralAssignmentSet assign_lits =
       k == 0            ? LiteralAssignmentSet() :
@@ -136,7 +250,183 @@ class Solver {
       assume_consistent ? grounder_.RelevantSplitTerms(phi) :
                           TermSet();
     const SortedTermSet& names = grounder_.Names();
-    return ReduceDisjunctions(s, assign_lits, names, k, phi, assume_consistent, relevant_terms);
+    const bool r = ReduceDisjunctions(s, assign_lits, names, k, phi, assume_consistent, relevant_terms);
+    grounder_.EndQuery();
+    if (query_cache_max_size_ > 0) {
+      entails_cache_.Insert(std::move(key), r, query_cache_max_size_);
+    }
+    return r;
+  }
+
+  // EntailsAll() and DeterminesAll() evaluate a batch of queries like
+  // Entails() and Determines(), respectively, but prepare and ground for all
+  // of them at once and search one split tree for all of them, see
+  // SplitAll(). The split terms are those of all queries, so a query may
+  // succeed in a batch even if it does not alone.
+  std::vector<bool> EntailsAll(int k, const std::vector<Formula::Ref>& phis, bool assume_consistent) {
+    assert(std::all_of(phis.begin(), phis.end(), [](const Formula::Ref& phi) { return phi->objective(); }));
+    assert(std::all_of(phis.begin(), phis.end(), [](const Formula::Ref& phi) { return phi->free_vars().empty(); }));
+    grounder_.PrepareForQuery(k, phis.begin(), phis.end());
+    const Setup& s = grounder_.Ground();
+    TermSet split_terms;
+    if (k > 0 && assume_consistent) {
+      for (const Formula::Ref& phi : phis) {
+        const TermSet ts = grounder_.RelevantSplitTerms(*phi);
+        split_terms.insert(ts.begin(), ts.end());
+      }
+    } else if (k > 0) {
+      split_terms = grounder_.SplitTerms();
+    }
+    const SortedTermSet& names = grounder_.Names();
+    std::vector<bool> rs(phis.size(), true);
+    if (!s.Subsumes(Clause{})) {
+      std::vector<Formula::Ref> conjuncts;
+      std::vector<internal::size_t> owners;
+      for (internal::size_t i = 0; i < phis.size(); ++i) {
+        ForAllConjuncts(names, *phis[i], [&conjuncts, &owners, i](const Formula& psi) {
+          conjuncts.push_back(psi.Clone());
+          owners.push_back(i);
+          return true;
+        });
+      }
+      std::vector<internal::size_t> goals(conjuncts.size());
+      std::iota(goals.begin(), goals.end(), 0);
+      std::vector<bool> results(conjuncts.size());
+      SplitAll<false>(s, split_terms.begin(), split_terms.end(), split_terms.size(), names, k,
+                      [this, &names, &conjuncts](const Setup& s, internal::size_t i) {
+                        return Reduce(s, names, *conjuncts[i]);
+                      },
+                      [](bool r1, bool r2) { return r1 && r2; },
+                      true, false, goals, &results);
+      for (internal::size_t j = 0; j < conjuncts.size(); ++j) {
+        if (!results[j]) {
+          rs[owners[j]] = false;
+        }
+      }
+    }
+    grounder_.EndQuery();
+    return rs;
+  }
+
+  std::vector<internal::Maybe<Term>> DeterminesAll(int k, const std::vector<Term>& lhss, bool assume_consistent) {
+    assert(std::all_of(lhss.begin(), lhss.end(), [](Term lhs) { return lhs.primitive(); }));
+    grounder_.PrepareForQuery(k, lhss.begin(), lhss.end());
+    const Setup& s = grounder_.Ground();
+    TermSet split_terms;
+    if (k > 0 && assume_consistent) {
+      for (const Term lhs : lhss) {
+        const TermSet ts = grounder_.RelevantSplitTerms(lhs);
+        split_terms.insert(ts.begin(), ts.end());
+      }
+    } else if (k > 0) {
+      split_terms = grounder_.SplitTerms();
+    }
+    const SortedTermSet& names = grounder_.Names();
+    std::vector<internal::size_t> goals(lhss.size());
+    std::iota(goals.begin(), goals.end(), 0);
+    std::vector<internal::Maybe<Term>> rs(lhss.size());
+    SplitAll<true>(s, split_terms.begin(), split_terms.end(), split_terms.size(), names, k,
+                   [&lhss](const Setup& s, internal::size_t i) { return s.Determines(lhss[i]); },
+                   [](internal::Maybe<Term> r1, internal::Maybe<Term> r2) {
+                     return r1 && r2 && r1.val == r2.val ? r1 :
+                            r1 && r2 && r1.val.null()    ? r2 :
+                            r1 && r2 && r2.val.null()    ? r1 :
+                                                           internal::Nothing;
+                   },
+                   internal::Maybe<Term>(internal::Just(Term())), internal::Maybe<Term>(internal::Nothing),
+                   goals, &rs);
+    grounder_.EndQuery();
+    return rs;
+  }
+
+  // EntailsUpTo() and DeterminesUpTo() evaluate a query at the split levels
+  // 0, ..., max_k until it succeeds, and set *k to that level; if it does not
+  // succeed, *k is the greatest level that was searched completely, or -1.
+  // The query is prepared and grounded once, and the subtrees of the split
+  // search are memoized across levels, see above. A conjunct of an Entails()
+  // query that is proven at one level is not searched again at the next.
+  // Given a deadline, the search stops when it passes, and the answer is that
+  // of the levels completed until then; as the subtrees cut off by the
+  // deadline fail, a successful answer is sound nonetheless. The levels are
+  // searched sequentially.
+  bool EntailsUpTo(int max_k, const Formula& phi, bool assume_consistent, int* k,
+                   Clock::time_point deadline = Clock::time_point::max()) {
+    assert(phi.objective());
+    assert(phi.free_vars().empty());
+    grounder_.PrepareForQuery(max_k, phi);
+    const Setup& s = grounder_.Ground();
+    TermSet split_terms =
+      max_k == 0        ? TermSet() :
+      assume_consistent ? grounder_.RelevantSplitTerms(phi) :
+                          grounder_.SplitTerms();
+    const SortedTermSet& names = grounder_.Names();
+    std::vector<Formula::Ref> conjuncts;
+    if (!s.Subsumes(Clause{})) {
+      ForAllConjuncts(names, phi, [&conjuncts](const Formula& psi) { conjuncts.push_back(psi.Clone()); return true; });
+    }
+    std::vector<TranspositionTable<bool>> tts;
+    for (internal::size_t i = 0; i < conjuncts.size(); ++i) {
+      tts.emplace_back(tt_max_size_, &tt_hits_, &tt_misses_, true);
+    }
+    std::vector<bool> proven(conjuncts.size(), false);
+    bool r = false;
+    *k = -1;
+    deadline_ = &deadline;
+    timed_out_ = false;
+    for (int l = 0; l <= max_k && !r && !timed_out(); ++l) {
+      r = true;
+      for (internal::size_t i = 0; i < conjuncts.size(); ++i) {
+        if (!proven[i]) {
+          const Formula& psi = *conjuncts[i];
+          proven[i] = Split<false>(s, split_terms.begin(), split_terms.end(), split_terms.size(), names, l,
+                                   [this, &names, &psi](const Setup& s) { return Reduce(s, names, psi); },
+                                   [](bool r1, bool r2) { return r1 && r2; },
+                                   true, false, tt_max_size_ > 0 ? &tts[i] : nullptr);
+          r &= proven[i];
+        }
+      }
+      if (r || !timed_out()) {
+        *k = l;
+      }
+    }
+    deadline_ = nullptr;
+    grounder_.EndQuery();
+    return r;
+  }
+
+  internal::Maybe<Term> DeterminesUpTo(int max_k, Term lhs, bool assume_consistent, int* k,
+                                       Clock::time_point deadline = Clock::time_point::max()) {
+    assert(lhs.primitive());
+    grounder_.PrepareForQuery(max_k, lhs);
+    const Setup& s = grounder_.Ground();
+    TermSet split_terms =
+      max_k == 0        ? TermSet() :
+      assume_consistent ? grounder_.RelevantSplitTerms(lhs) :
+                          grounder_.SplitTerms();
+    const SortedTermSet& names = grounder_.Names();
+    TranspositionTable<internal::Maybe<Term>> tt(tt_max_size_, &tt_hits_, &tt_misses_);
+    internal::Maybe<Term> r = internal::Nothing;
+    *k = -1;
+    deadline_ = &deadline;
+    timed_out_ = false;
+    for (int l = 0; l <= max_k && !r && !timed_out(); ++l) {
+      r = Split<true>(s, split_terms.begin(), split_terms.end(), split_terms.size(), names, l,
+                      [&lhs](const Setup& s) { return s.Determines(lhs); },
+                      [](internal::Maybe<Term> r1, internal::Maybe<Term> r2) {
+                        return r1 && r2 && r1.val == r2.val ? r1 :
+                               r1 && r2 && r1.val.null()    ? r2 :
+                               r1 && r2 && r2.val.null()    ? r1 :
+                                                              internal::Nothing;
+                      },
+                      internal::Maybe<Term>(internal::Just(Term())), internal::Maybe<Term>(internal::Nothing),
+                      tt_max_size_ > 0 ? &tt : nullptr);
+      if (r || !timed_out()) {
+        *k = l;
+      }
+    }
+    deadline_ = nullptr;
+    grounder_.EndQuery();
+    return r;
   }
 
  private:
@@ -149,11 +439,209 @@ class Solver {
   typedef Grounder::LiteralAssignmentSet LiteralAssignmentSet;
   typedef Grounder::SortedTermSet SortedTermSet;
 
+  template<typename T>
+  class TranspositionTable {
+   public:
+    struct Key {
+      bool operator==(const Key& key) const {
+        return fingerprint == key.fingerprint && k == key.k && n_split_terms == key.n_split_terms;
+      }
+
+      internal::hash64_t fingerprint;
+      int k;
+      internal::size_t n_split_terms;
+    };
+
+    // If monotone, a successful result at a split level is also a result at
+    // every greater split level.
+    TranspositionTable(internal::size_t max_size, internal::size_t* hits, internal::size_t* misses,
+                       bool monotone = false)
+        : max_size_(max_size), hits_(hits), misses_(misses), monotone_(monotone) {}
+
+    const T* Find(const Key& key) {
+      auto it = map_.find(key);
+      for (int k = key.k - 1; monotone_ && it == map_.end() && k >= 0; --k) {
+        it = map_.find(Key{key.fingerprint, k, key.n_split_terms});
+        if (it != map_.end() && !it->second) {
+          it = map_.end();
+        }
+      }
+      if (it == map_.end()) {
+        ++*misses_;
+        return nullptr;
+      }
+      ++*hits_;
+      return &it->second;
+    }
+
+    void Insert(const Key& key, T result) {
+      if (map_.size() >= max_size_) {
+        map_.clear();
+      }
+      map_.insert(std::make_pair(key, result));
+    }
+
+   private:
+    struct KeyHash {
+      internal::hash64_t operator()(const Key& key) const {
+        return key.fingerprint ^ internal::jenkins_hash(static_cast<internal::u32>(key.k) << 24 ^
+                                                        static_cast<internal::u32>(key.n_split_terms));
+      }
+    };
+
+    internal::size_t max_size_;
+    internal::size_t* hits_;
+    internal::size_t* misses_;
+    bool monotone_;
+    std::unordered_map<Key, T, KeyHash> map_;
+  };
+
+  enum QueryKind { kEntailsQuery, kDeterminesQuery, kConsistentQuery };
+
+  struct QueryKey {
+    bool operator==(const QueryKey& key) const {
+      return kind == key.kind && k == key.k && assume_consistent == key.assume_consistent && lhs == key.lhs &&
+             (phi && key.phi ? *phi == *key.phi : phi == key.phi);
+    }
+
+    QueryKind kind;
+    int k;
+    bool assume_consistent;
+    Term lhs;
+    Formula::Ref phi;
+  };
+
+  // QueryCache is a bounded map from QueryKey to the query result, which
+  // evicts the least recently used entry. The keys are owned by the map;
+  // the list holds pointers to them in the order of their last use.
+  template<typename T>
+  class QueryCache {
+   public:
+    const T* Find(const QueryKey& key) {
+      auto it = map_.find(key);
+      if (it == map_.end()) {
+        return nullptr;
+      }
+      lru_.splice(lru_.begin(), lru_, it->second.pos);
+      return &it->second.result;
+    }
+
+    void Insert(QueryKey key, T result, internal::size_t max_size) {
+      while (!lru_.empty() && map_.size() >= max_size) {
+        map_.erase(map_.find(*lru_.back()));
+        lru_.pop_back();
+      }
+      auto p = map_.insert(std::make_pair(std::move(key), Entry{result, lru_.end()}));
+      if (p.second) {
+        lru_.push_front(&p.first->first);
+        p.first->second.pos = lru_.begin();
+      }
+    }
+
+    void Clear() {
+      map_.clear();
+      lru_.clear();
+    }
+
+    internal::size_t version = 0;
+
+   private:
+    struct Entry {
+      T result;
+      std::list<const QueryKey*>::iterator pos;
+    };
+
+    struct KeyHash {
+      internal::hash32_t operator()(const QueryKey& key) const {
+        internal::hash32_t h = internal::jenkins_hash(static_cast<internal::u32>(key.k) << 3 ^
+                                                      static_cast<internal::u32>(key.kind) << 1 ^
+                                                      static_cast<internal::u32>(key.assume_consistent));
+        h ^= key.lhs.null() ? 0 : key.lhs.hash();
+        if (key.phi) {
+          key.phi->Traverse([&h](Literal a) { h = (h * 31) ^ a.hash(); return true; });
+        }
+        return h;
+      }
+    };
+
+    std::unordered_map<QueryKey, Entry, KeyHash> map_;
+    std::list<const QueryKey*> lru_;
+  };
+
+  // Looks up the result of a query after PrepareForQuery(), which may have
+  // changed the grounder's version; the cache is cleared in that case.
+  template<typename T>
+  const T* FindQuery(QueryCache<T>* cache, const QueryKey& key) {
+    const internal::size_t version = grounder_.version();
+    if (cache->version != version) {
+      cache->Clear();
+      cache->version = version;
+    }
+    const T* r = cache->Find(key);
+    ++*(r ? &query_cache_hits_ : &query_cache_misses_);
+    return r;
+  }
+
+  // Renames the bound variables of phi to the i-th canonical variable of
+  // their sort, where i is the number of enclosing quantifiers of that sort.
+  Formula::Ref Canonical(const Formula& phi) {
+    internal::IntMap<Symbol::Sort, internal::size_t> depth;
+    return Canonical(phi, &depth);
+  }
+
+  Formula::Ref Canonical(const Formula& phi, internal::IntMap<Symbol::Sort, internal::size_t>* depth) {
+    switch (phi.type()) {
+      case Formula::kNot:
+        return Formula::Factory::Not(Canonical(phi.as_not().arg(), depth));
+      case Formula::kOr:
+        return Formula::Factory::Or(Canonical(phi.as_or().lhs(), depth), Canonical(phi.as_or().rhs(), depth));
+      case Formula::kExists: {
+        const Term x = phi.as_exists().x();
+        std::vector<Term>& vars = canonical_vars_[x.sort()];
+        const internal::size_t i = (*depth)[x.sort()]++;
+        if (i == vars.size()) {
+          vars.push_back(tf_->CreateTerm(sf_->CreateVariable(x.sort())));
+        }
+        const Term y = vars[i];
+        Formula::Ref psi = phi.as_exists().arg().Clone();
+        psi->SubstituteFree(Term::Substitution(x, y), tf_);
+        psi = Canonical(*psi, depth);
+        --(*depth)[x.sort()];
+        return Formula::Factory::Exists(y, std::move(psi));
+      }
+      default:
+        return phi.Clone();
+    }
+  }
+
+  // Checks the deadline of EntailsUpTo() or DeterminesUpTo(), if any; once
+  // it has passed, the remaining subtrees fail.
+  bool timed_out() {
+    if (deadline_ && !timed_out_ && Clock::now() >= *deadline_) {
+      timed_out_ = true;
+    }
+    return deadline_ && timed_out_;
+  }
+
   bool ReduceConjunctions(const Setup& s,
                           const TermSet& split_terms,
                           const SortedTermSet& names,
                           int k,
                           const Formula& phi) {
+    return ForAllConjuncts(names, phi, [&, this](const Formula& psi) {
+      // Reducing quantifiers creates terms, which must not happen on
+      // multiple threads; clauses can be checked in parallel, though.
+      return Split<false>(s, split_terms, names, k,
+                          [this, &names, &psi](const Setup& s) { return Reduce(s, names, psi); },
+                          [](bool r1, bool r2) { return r1 && r2; },
+                          true, false, psi.type() == Formula::kAtomic);
+    });
+  }
+
+  // Reduces the outermost logical operators with conjunctive meaning and
+  // checks whether conjunct holds for every conjunct that remains.
+  template<typename UnaryPredicate>
+  bool ForAllConjuncts(const SortedTermSet& names, const Formula& phi, UnaryPredicate conjunct) {
     assert(phi.objective());
     switch (phi.type()) {
       case Formula::kNot: {
@@ -163,17 +651,17 @@ class Solver {
             return std::all_of(c.begin(), c.end(), [&, this](Literal a) {
               a = a.flip();
               Formula::Ref psi = Formula::Factory::Atomic(Clause{a});
-              return ReduceConjunctions(s, split_terms, names, k, *psi);
+              return ForAllConjuncts(names, *psi, conjunct);
             });
           }
           case Formula::kNot: {
-            return ReduceConjunctions(s, split_terms, names, k, phi.as_not().arg().as_not().arg());
+            return ForAllConjuncts(names, phi.as_not().arg().as_not().arg(), conjunct);
           }
           case Formula::kOr: {
             Formula::Ref left = Formula::Factory::Not(phi.as_not().arg().as_or().lhs().Clone());
             Formula::Ref right = Formula::Factory::Not(phi.as_not().arg().as_or().rhs().Clone());
-            return ReduceConjunctions(s, split_terms, names, k, *left) &&
-                   ReduceConjunctions(s, split_terms, names, k, *right);
+            return ForAllConjuncts(names, *left, conjunct) &&
+                   ForAllConjuncts(names, *right, conjunct);
           }
           case Formula::kExists: {
             const Term x = phi.as_not().arg().as_exists().x();
@@ -182,7 +670,7 @@ class Solver {
             return std::all_of(ns.begin(), ns.end(), [&, this](const Term n) {
               Formula::Ref xi = Formula::Factory::Not(psi.Clone());
               xi->SubstituteFree(Term::Substitution(x, n), tf_);
-              return ReduceConjunctions(s, split_terms, names, k, *xi);
+              return ForAllConjuncts(names, *xi, conjunct);
             });
           }
           default:
@@ -193,10 +681,7 @@ class Solver {
         if (phi.trivially_valid()) {
           return true;
         }
-        return Split<false>(s, split_terms, names, k,
-                            [this, &names, &phi](const Setup& s) { return Reduce(s, names, phi); },
-                            [](bool r1, bool r2) { return r1 && r2; },
-                            true, false);
+        return conjunct(phi);
       }
     }
     throw;
@@ -327,11 +812,107 @@ class Solver {
           GoalPredicate goal,
           MergeResultPredicate merge,
           T inconsistent_result,
-          T unsuccessful_result) {
+          T unsuccessful_result,
+          bool parallelizable) {
+    if (parallelizable && pool_ && k >= 2) {
+      return ParallelSplit<split_order_matters>(s, split_terms, names, k, goal, merge,
+                                                inconsistent_result, unsuccessful_result);
+    }
+    if (tt_max_size_ > 0 && k >= 2) {
+      TranspositionTable<T> tt(tt_max_size_, &tt_hits_, &tt_misses_);
+      return Split<split_order_matters>(s, split_terms.begin(), split_terms.end(), split_terms.size(), names, k,
+                                        goal, merge, inconsistent_result, unsuccessful_result, &tt);
+    }
     return Split<split_order_matters>(s, split_terms.begin(), split_terms.end(), split_terms.size(), names, k,
                                       goal, merge, inconsistent_result, unsuccessful_result);
   }
 
+  // ParallelSplit() does the same as Split(), except that the subtrees of the
+  // names of a split term are searched on the threads of pool_, each of which
+  // backtracks on its own overlay of the setup. The results are merged in the
+  // order the subtrees finish, which is fine because merge is commutative and
+  // associative. Once the merged result of a split term has failed, the
+  // remaining subtrees are cancelled.
+  template<bool split_order_matters, typename T, typename GoalPredicate, typename MergeResultPredicate>
+  T ParallelSplit(const Setup& s,
+                  const TermSet& split_terms,
+                  const SortedTermSet& names,
+                  int k,
+                  GoalPredicate goal,
+                  MergeResultPredicate merge,
+                  T inconsistent_result,
+                  T unsuccessful_result) {
+    assert(pool_ && k > 0);
+    if (s.contains_empty_clause()) {
+      return unsuccessful_result;
+    } else if (split_terms.empty()) {
+      return goal(s);
+    }
+    const TermSet::const_iterator split_terms_begin = split_terms.begin();
+    const TermSet::const_iterator split_terms_end = split_terms.end();
+    const internal::size_t n_split_terms = split_terms.size();
+    const internal::size_t k_size = static_cast<internal::size_t>(k);
+    std::vector<internal::Maybe<Setup>> setups(pool_->size() + 1);
+    internal::size_t n_split_terms_left = n_split_terms;
+    bool recursed = false;
+    for (auto it = split_terms_begin; it != split_terms_end; ) {
+      if (n_split_terms >= k_size && n_split_terms_left < k_size - 1) {
+        break;
+      }
+      const Term t = *it++;
+      --n_split_terms_left;
+      if (s.Determines(t)) {
+        continue;
+      }
+      const TermSet& ns = names[t.sort()];
+      assert(!ns.empty());
+      const std::vector<Term> ns_vec(ns.begin(), ns.end());
+      std::mutex mutex;
+      std::atomic<bool> cancelled(false);
+      T merged_result = unsuccessful_result;
+      pool_->Run(ns_vec.size(), [&, it, n_split_terms_left](internal::size_t i, internal::size_t thread) {
+        if (cancelled) {
+          return;
+        }
+        if (!setups[thread]) {
+          setups[thread] = internal::Just(s.Overlay());
+        }
+        Setup::ShallowCopy split_setup = setups[thread].val.shallow_copy();
+        const Setup::Result add_result = split_setup.AddUnit(Literal::Eq(t, ns_vec[i]));
+        const T split_result = add_result == Setup::kInconsistent ? inconsistent_result :
+            Split<split_order_matters>(*split_setup,
+                                       split_order_matters ? split_terms_begin : it,
+                                       split_terms_end,
+                                       split_order_matters ? n_split_terms : n_split_terms_left,
+                                       names,
+                                       k - 1,
+                                       goal,
+                                       merge,
+                                       inconsistent_result,
+                                       unsuccessful_result,
+                                       static_cast<TranspositionTable<T>*>(nullptr),
+                                       &cancelled);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cancelled) {
+          return;
+        }
+        merged_result = !merged_result ? split_result : merge(merged_result, split_result);
+        if (!split_result || !merged_result) {
+          cancelled = true;
+        } else {
+          recursed = true;
+        }
+      });
+      if (!cancelled) {
+        return merged_result;
+      }
+    }
+    // Since the subtrees finish in arbitrary order, recursed may differ from
+    // what Split() computes. This does not change the result: goal is
+    // monotonic, so if no split term succeeds, neither does goal(s).
+    return recursed ? unsuccessful_result : goal(s);
+  }
+
   template<bool split_order_matters, typename T, typename GoalPredicate, typename MergeResultPredicate>
   T Split(const Setup& s,
           const TermSet::const_iterator split_terms_begin,
@@ -342,7 +923,9 @@ class Solver {
           GoalPredicate goal,
           MergeResultPredicate merge,
           T inconsistent_result,
-          T unsuccessful_result) {
+          T unsuccessful_result,
+          TranspositionTable<T>* tt = nullptr,
+          const std::atomic<bool>* cancelled = nullptr) {
     // For Determines(), the split order matters, for Entails() it does not.
     // Suppose we have two split terms t1, t2, t3 and two names n1, n2, and
     // a query term t and two candidate names n, n' for t.
@@ -391,26 +974,40 @@ class Solver {
         const TermSet& ns = names[t.sort()];
         assert(!ns.empty());
         for (const Term n : ns) {
-          Setup::ShallowCopy split_setup = s.shallow_copy();
-          const Setup::Result add_result = split_setup.AddUnit(Literal::Eq(t, n));
-          if (add_result == Setup::kInconsistent) {
-            merged_result = !merged_result ? inconsistent_result : merge(merged_result, inconsistent_result);
-            if (!merged_result) {
-              goto next_split;
+          if ((cancelled && *cancelled) || timed_out()) {
+            return unsuccessful_result;
+          }
+          // The subtree is looked up before the split is done, as t is not
+          // determined and hence (t = n) is not subsumed.
+          const Literal a = Literal::Eq(t, n);
+          const internal::size_t n_split_terms_next = split_order_matters ? n_split_terms : n_split_terms_left;
+          // With at least as many splits left as split terms, all of them can
+          // be split, so the result is the same for any greater split level.
+          const int k_next = std::min(k - 1, static_cast<int>(n_split_terms_next));
+          const typename TranspositionTable<T>::Key key{s.fingerprint() ^ Setup::Fingerprint(a), k_next,
+                                                        n_split_terms_next};
+          const T* memoized_result = tt ? tt->Find(key) : nullptr;
+          T split_result = memoized_result ? *memoized_result : unsuccessful_result;
+          if (!memoized_result) {
+            Setup::ShallowCopy split_setup = s.shallow_copy();
+            const Setup::Result add_result = split_setup.AddUnit(a);
+            split_result = add_result == Setup::kInconsistent ? inconsistent_result :
+                Split<split_order_matters>(*split_setup,
+                                           split_order_matters ? split_terms_begin : it,
+                                           split_terms_end,
+                                           n_split_terms_next,
+                                           names,
+                                           k - 1,
+                                           goal,
+                                           merge,
+                                           inconsistent_result,
+                                           unsuccessful_result,
+                                           tt,
+                                           cancelled);
+            if (tt && !timed_out()) {
+              tt->Insert(key, split_result);
             }
-            recursed = true;
-            continue;
           }
-          auto split_result = Split<split_order_matters>(*split_setup,
-                                                         split_order_matters ? split_terms_begin : it,
-                                                         split_terms_end,
-                                                         split_order_matters ? n_split_terms : n_split_terms_left,
-                                                         names,
-                                                         k - 1,
-                                                         goal,
-                                                         merge,
-                                                         inconsistent_result,
-                                                         unsuccessful_result);
           if (!split_result) {
             goto next_split;
           }
@@ -430,6 +1027,123 @@ next_split:
     }
   }
 
+  // SplitAll() does the same as Split() for several goals at once, where
+  // goal(s, i) is the i-th goal, and stores the result of the goals listed in
+  // goals in results. Every split is done once for all the goals that have
+  // not succeeded with an earlier split term; the subtree of a split is
+  // searched for those goals whose result is not yet known to fail.
+  template<bool split_order_matters, typename T, typename GoalPredicate, typename MergeResultPredicate>
+  void SplitAll(const Setup& s,
+                const TermSet::const_iterator split_terms_begin,
+                const TermSet::const_iterator split_terms_end,
+                const internal::size_t n_split_terms,
+                const SortedTermSet& names,
+                int k,
+                GoalPredicate goal,
+                MergeResultPredicate merge,
+                T inconsistent_result,
+                T unsuccessful_result,
+                const std::vector<internal::size_t>& goals,
+                std::vector<T>* results) {
+    assert(static_cast<internal::size_t>(std::distance(split_terms_begin, split_terms_end)) == n_split_terms);
+    if (s.contains_empty_clause()) {
+      for (const internal::size_t i : goals) {
+        (*results)[i] = unsuccessful_result;
+      }
+    } else if (k > 0 && n_split_terms > 0) {
+      assert(split_terms_begin != split_terms_end);
+      const internal::size_t k_size = static_cast<internal::size_t>(k);
+      std::vector<internal::size_t> open = goals;
+      std::vector<bool> recursed(open.size(), false);
+      internal::size_t n_split_terms_left = n_split_terms;
+      for (auto it = split_terms_begin; it != split_terms_end; ) {
+        if (n_split_terms >= k_size && n_split_terms_left < k_size - 1) {
+          break;
+        }
+        const Term t = *it++;
+        --n_split_terms_left;
+        if (s.Determines(t)) {
+          continue;
+        }
+        std::vector<T> merged_results(open.size(), unsuccessful_result);
+        std::vector<bool> failed(open.size(), false);
+        const TermSet& ns = names[t.sort()];
+        assert(!ns.empty());
+        for (const Term n : ns) {
+          std::vector<internal::size_t> split_goals;
+          for (internal::size_t j = 0; j < open.size(); ++j) {
+            if (!failed[j]) {
+              split_goals.push_back(open[j]);
+            }
+          }
+          if (split_goals.empty()) {
+            break;
+          }
+          // The results of the subtree are stored in results, which is fine
+          // as the results of the open goals are not yet known.
+          Setup::ShallowCopy split_setup = s.shallow_copy();
+          const Setup::Result add_result = split_setup.AddUnit(Literal::Eq(t, n));
+          if (add_result == Setup::kInconsistent) {
+            for (const internal::size_t i : split_goals) {
+              (*results)[i] = inconsistent_result;
+            }
+          } else {
+            SplitAll<split_order_matters>(*split_setup,
+                                          split_order_matters ? split_terms_begin : it,
+                                          split_terms_end,
+                                          split_order_matters ? n_split_terms : n_split_terms_left,
+                                          names,
+                                          k - 1,
+                                          goal,
+                                          merge,
+                                          inconsistent_result,
+                                          unsuccessful_result,
+                                          split_goals,
+                                          results);
+          }
+          for (internal::size_t j = 0; j < open.size(); ++j) {
+            if (failed[j]) {
+              continue;
+            }
+            const T split_result = (*results)[open[j]];
+            if (!split_result) {
+              failed[j] = true;
+              continue;
+            }
+            merged_results[j] = !merged_results[j] ? split_result : merge(merged_results[j], split_result);
+            if (!merged_results[j]) {
+              failed[j] = true;
+              continue;
+            }
+            recursed[j] = true;
+          }
+        }
+        internal::size_t n_open = 0;
+        for (internal::size_t j = 0; j < open.size(); ++j) {
+          if (!failed[j]) {
+            (*results)[open[j]] = merged_results[j];
+          } else {
+            open[n_open] = open[j];
+            recursed[n_open] = recursed[j];
+            ++n_open;
+          }
+        }
+        open.resize(n_open);
+        recursed.resize(n_open);
+        if (open.empty()) {
+          return;
+        }
+      }
+      for (internal::size_t j = 0; j < open.size(); ++j) {
+        (*results)[open[j]] = recursed[j] ? unsuccessful_result : goal(s, open[j]);
+      }
+    } else {
+      for (const internal::size_t i : goals) {
+        (*results)[i] = goal(s, i);
+      }
+    }
+  }
+
   bool Assign(const Setup& s,
               const LiteralAssignmentSet& assign_lits,
               const SortedTermSet& names,
@@ -446,12 +1160,15 @@ next_split:
         return phi.trivially_valid();
       }
       assert(!assign_lits.empty());
-      return std::any_of(assign_lits.begin(), assign_lits.end(), [&](const LiteralSet& lits) {
+      return std::any_of(assign_lits.begin(), assign_lits.end(), [&](LiteralAssignmentSet::Literals lits) {
         assert(!lits.empty());
         Setup::ShallowCopy split_setup = s.shallow_copy();
         for (Literal a : lits) {
           if (!s.Subsumes(Clause{a.flip()})) {
-            split_setup.AddUnit(a);
+            // LocallyConsistent() and Reduce() below look at the units even if
+            // the assignment is inconsistent, so they must not depend on the
+            // nogoods learned by earlier queries.
+            split_setup.AddUnit(a, false);
           }
         }
         return Assign(*split_setup, assign_lits, names, k-1, phi, assume_consistent, relevant_terms);
@@ -470,8 +1187,21 @@ next_split:
     }
   }
 
+  Symbol::Factory* sf_;
   Term::Factory* tf_;
   Grounder grounder_;
+  std::unique_ptr<internal::ThreadPool> pool_;
+  internal::size_t tt_max_size_ = kDefaultTranspositionTableSize;
+  internal::size_t tt_hits_ = 0;
+  internal::size_t tt_misses_ = 0;
+  internal::size_t query_cache_max_size_ = 0;
+  internal::size_t query_cache_hits_ = 0;
+  internal::size_t query_cache_misses_ = 0;
+  QueryCache<bool> entails_cache_;
+  QueryCache<internal::Maybe<Term>> determines_cache_;
+  internal::IntMap<Symbol::Sort, std::vector<Term>> canonical_vars_;
+  const Clock::time_point* deadline_ = nullptr;
+  bool timed_out_ = false;
 };
 
 }  // namespace limbo
@@ -15,12 +15,26 @@
 // are interned and represented only with an index in the heap structure.
 // Creating a Term a second time yields the same index.
 //
+// The symbol and the arguments of a Term are stored next to each other in an
+// arena of large, contiguous chunks. Terms are looked up in an open-addressing
+// hash table of indices, keyed by symbol and arguments, before anything is
+// allocated. Hence a Term costs no more than its symbol, its arguments, and a
+// few slots in the heap and the hash table.
+//
 // Using an index as opposed to a memory address gives us more control over how
 // the representation of the Term looks like. In particular, it gets us the
 // following advantages: fast yet deterministic (wrt multiple executions)
 // hashing; smaller representation (31 bit); possibility to represent
 // information in the index.
 //
+// Symbol::Factory and Term::Factory may be used concurrently from multiple
+// threads, for instance, by independent Solvers, provided that their
+// Instance() has been called once before. Term::Factory splits the hash table
+// into shards, each with its own mutex and arena. Looking up an existing Term
+// takes no lock, nor do the accessors of Terms, since the heap structure never
+// moves the entries that have been created already. The indices of Terms then
+// depend on the order in which the threads create them.
+//
 // Literal is a friend class of Term and builds on the memory layout of Term.
 // In particular, exploits that Term::name() is encoded in Term::id(). That way
 // certain operations on Terms and Literals can be expressed as bitwise
@@ -32,14 +46,15 @@
 #include <cassert>
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
+#include <new>
 #include <utility>
 #include <vector>
 
 #include <limbo/internal/hash.h>
-#include <limbo/internal/intmap.h>
 #include <limbo/internal/ints.h>
 #include <limbo/internal/maybe.h>
 
@@ -97,10 +112,10 @@ class Symbol {
     Factory(Factory&&) = delete;
     Factory& operator=(Factory&&) = delete;
 
-    Sort last_sort_ = 0;
-    Id last_function_ = 0;
-    Id last_name_ = 0;
-    Id last_variable_ = 0;
+    std::atomic<Sort> last_sort_{0};
+    std::atomic<Id> last_function_{0};
+    std::atomic<Id> last_name_{0};
+    std::atomic<Id> last_variable_{0};
   };
 
   bool operator==(Symbol s) const {
@@ -136,6 +151,7 @@ class Term {
   class Factory;
   struct Substitution;
   typedef std::vector<Term> Vector;  // using Vector within Term will be legal in C++17, but seems to be illegal before
+  class Args;
   typedef internal::i8 UnificationConfiguration;
 
   static constexpr UnificationConfiguration kUnifyLeft = (1 << 0);
@@ -156,9 +172,14 @@ class Term {
 
   internal::hash32_t hash() const { return internal::jenkins_hash(id_); }
 
-  inline Symbol symbol()      const;
-  inline Term arg(size_t i)   const;
-  inline const Vector& args() const;
+  // The position of the term in its heap. Names and non-names are stored in
+  // separate heaps, so the index is dense and unique only among terms of the
+  // same kind. The null term has index 0.
+  internal::u32 index() const { return id_ >> 1; }
+
+  inline Symbol symbol()    const;
+  inline Term arg(size_t i) const;
+  inline Args args()        const;
 
   Symbol::Sort sort()   const { return symbol().sort(); }
   bool name()           const { assert(symbol().name() == (id_ & 1)); return (id_ & 1) == 1; }
@@ -167,9 +188,9 @@ class Term {
   Symbol::Arity arity() const { return symbol().arity(); }
 
   bool null()           const { return id_ == 0; }
-  bool ground()         const { return name() || (function() && all_args([](Term t) { return t.ground(); })); }
-  bool primitive()      const { return function() && all_args([](Term t) { return t.name(); }); }
-  bool quasiprimitive() const { return function() && all_args([](Term t) { return t.name() || t.variable(); }); }
+  inline bool ground()         const;
+  inline bool primitive()      const;
+  inline bool quasiprimitive() const;
 
   bool Mentions(Term t) const { return *this == t || any_arg([t](Term tt) { return t == tt; }); }
 
@@ -209,22 +230,42 @@ class Term {
   u32 id_;
 };
 
+// The arguments of a Term, a range over the arena.
+class Term::Args {
+ public:
+  typedef const Term* iterator;
+  typedef const Term* const_iterator;
+  typedef Term value_type;
+
+  Args(const Term* begin, const Term* end) : begin_(begin), end_(end) {}
+
+  iterator begin() const { return begin_; }
+  iterator end()   const { return end_; }
+
+  size_t size() const { return end_ - begin_; }
+  Term operator[](size_t i) const { return begin_[i]; }
+
+ private:
+  const Term* begin_;
+  const Term* end_;
+};
+
+// The arguments are stored immediately after the Data in the arena. Since
+// Terms are immutable, the structural properties that would otherwise require
+// recursion are computed once on creation and stored as flags.
 struct Term::Data {
-  Data(Symbol symbol, const Vector& args) : symbol(symbol), args(args) {}
+  typedef internal::u8 Flags;
 
-  bool operator==(const Data& d) const { return symbol == d.symbol && args == d.args; }
-  bool operator!=(const Data& s) const { return !(*this == s); }
+  static constexpr Flags kGround         = (1 << 0);
+  static constexpr Flags kPrimitive      = (1 << 1);
+  static constexpr Flags kQuasiprimitive = (1 << 2);
 
-  internal::hash32_t hash() const {
-    internal::hash32_t h = symbol.hash();
-    for (const limbo::Term t : args) {
-      h ^= t.hash();
-    }
-    return h;
-  }
+  Data(Symbol symbol, Flags flags) : symbol(symbol), flags(flags) {}
+
+  const Term* args() const { return reinterpret_cast<const Term*>(this + 1); }
 
   Symbol symbol;
-  Vector args;
+  Flags flags;
 };
 
 class Term::Factory : private Singleton<Factory> {
@@ -238,35 +279,34 @@ class Term::Factory : private Singleton<Factory> {
 
   static void Reset() { instance = nullptr; }
 
-  ~Factory() {
-    for (Data* data : name_heap_) {
-      delete data;
-    }
-    for (Data* data : variable_and_function_heap_) {
-      delete data;
-    }
-  }
-
   Term CreateTerm(Symbol symbol) {
     return CreateTerm(symbol, {});
   }
 
   Term CreateTerm(Symbol symbol, const Vector& args) {
     assert(symbol.arity() == static_cast<Symbol::Arity>(args.size()));
-    Data* d = new Data(symbol, args);
-    DataPtrSet* s = &memory_[symbol.sort()];
-    auto it = s->find(d);
-    if (it == s->end()) {
-      std::vector<Data*>* heap = symbol.name() ? &name_heap_ : &variable_and_function_heap_;
-      heap->push_back(d);
-      const u32 id = (static_cast<u32>(heap->size()) << 1) | static_cast<u32>(symbol.name());
-      s->insert(std::make_pair(d, id));
-      return Term(id);
-    } else {
-      const u32 id = it->second;
-      delete d;
+    const internal::hash32_t h = hash(symbol, args.data());
+    Shard* shard = &shards_[h >> (32 - kShardBits)];
+    u32 id = Find(*shard->table.load(std::memory_order_acquire), h, symbol, args.data());
+    if (id != 0) {
       return Term(id);
     }
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    Table* table = shard->table.load(std::memory_order_relaxed);
+    size_t i = h & table->mask;
+    for (; (id = table->slots[i].load(std::memory_order_relaxed)) != 0; i = (i + 1) & table->mask) {
+      if (Equals(get(id), symbol, args.data())) {
+        return Term(id);
+      }
+    }
+    const Data* d = Allocate(shard, symbol, args.data());
+    Heap* heap = symbol.name() ? &name_heap_ : &variable_and_function_heap_;
+    id = (static_cast<u32>(heap->push_back(d)) << 1) | static_cast<u32>(symbol.name());
+    table->slots[i].store(id, std::memory_order_release);
+    if (2 * ++shard->n_terms > table->mask + 1) {
+      Rehash(shard);
+    }
+    return Term(id);
   }
 
   const Data* get(u32 id) const {
@@ -278,8 +318,114 @@ class Term::Factory : private Singleton<Factory> {
   }
 
  private:
-  struct DataPtrHash   { internal::hash32_t operator()(const Term::Data* d) const { return d->hash(); } };
-  struct DataPtrEquals { bool operator()(const Term::Data* a, const Term::Data* b) const { return *a == *b; } };
+  // A vector whose push_back() and operator[] may be called concurrently. It
+  // consists of segments of fixed size that are allocated on demand and never
+  // move, and push_back() claims the next index atomically. The index is
+  // dense, but concurrent push_back()s may complete out of order; hence an
+  // element must not be read before its index has been communicated.
+  class Heap {
+   public:
+    Heap() : segments_(new std::atomic<const Data**>[kMaxSegments]()) {}
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+    Heap(Heap&&) = delete;
+    Heap& operator=(Heap&&) = delete;
+
+    ~Heap() {
+      for (size_t s = 0; s < kMaxSegments; ++s) {
+        delete[] segments_[s].load(std::memory_order_relaxed);
+      }
+    }
+
+    const Data* operator[](size_t i) const {
+      return segments_[i >> kSegmentBits].load(std::memory_order_acquire)[i & (kSegmentSize - 1)];
+    }
+
+    // Returns the new size, which is the index of d plus one.
+    size_t push_back(const Data* d) {
+      const size_t i = size_.fetch_add(1, std::memory_order_relaxed);
+      const size_t s = i >> kSegmentBits;
+      assert(s < kMaxSegments);
+      const Data** segment = segments_[s].load(std::memory_order_acquire);
+      if (!segment) {
+        const Data** new_segment = new const Data*[kSegmentSize];
+        if (segments_[s].compare_exchange_strong(segment, new_segment, std::memory_order_acq_rel)) {
+          segment = new_segment;
+        } else {
+          delete[] new_segment;
+        }
+      }
+      segment[i & (kSegmentSize - 1)] = d;
+      return i + 1;
+    }
+
+   private:
+    static constexpr size_t kSegmentBits = 16;
+    static constexpr size_t kSegmentSize = 1 << kSegmentBits;
+    static constexpr size_t kMaxSegments = 1 << 14;
+
+    std::unique_ptr<std::atomic<const Data**>[]> segments_;
+    std::atomic<size_t> size_{0};
+  };
+
+  // An open-addressing hash table of term ids, 0 meaning empty. Slots are
+  // only ever set from empty to an id. When a Table gets too full, it is
+  // replaced by a larger one, but kept alive for lock-free readers.
+  struct Table {
+    explicit Table(size_t size) : mask(size - 1), slots(new std::atomic<u32>[size]()) {}
+
+    size_t mask;
+    std::unique_ptr<std::atomic<u32>[]> slots;
+  };
+
+  // Every shard covers the terms whose hash has a certain prefix. Insertions
+  // are serialized by the shard's mutex; lookups probe without locking.
+  struct Shard {
+    Shard() : table(new Table(kInitialTableSize)) { tables.emplace_back(table.load(std::memory_order_relaxed)); }
+
+    std::mutex mutex;
+    std::atomic<Table*> table;
+    std::vector<std::unique_ptr<Table>> tables;
+    size_t n_terms = 0;
+    std::vector<std::unique_ptr<u32[]>> chunks;
+    size_t chunk_used = 0;
+  };
+
+  static constexpr size_t kShardBits = 6;
+  static constexpr size_t kInitialTableSize = 64;
+  // The Data and arguments of a Term take sizeof(Data) / sizeof(u32) + arity
+  // words, which is far less than a chunk for every arity.
+  static constexpr size_t kChunkSize = 1 << 14;
+  static_assert(sizeof(Data) % sizeof(u32) == 0 && alignof(Data) <= alignof(u32), "Data must fit into u32 words");
+  static_assert(sizeof(Term) == sizeof(u32), "Term must be a single word");
+
+  static internal::hash32_t hash(Symbol symbol, const Term* args) {
+    internal::hash32_t h = symbol.hash();
+    for (Symbol::Arity i = 0; i < symbol.arity(); ++i) {
+      h = (h ^ args[i].hash()) * 0x01000193;
+    }
+    return h;
+  }
+
+  static Data::Flags flags(Symbol symbol, const Term* args) {
+    const Term* end = args + symbol.arity();
+    Data::Flags f = 0;
+    if (symbol.name() || (symbol.function() && std::all_of(args, end, [](Term t) { return t.ground(); }))) {
+      f |= Data::kGround;
+    }
+    if (symbol.function() && std::all_of(args, end, [](Term t) { return t.name(); })) {
+      f |= Data::kPrimitive;
+    }
+    if (symbol.function() && std::all_of(args, end, [](Term t) { return t.name() || t.variable(); })) {
+      f |= Data::kQuasiprimitive;
+    }
+    return f;
+  }
+
+  static bool Equals(const Data* d, Symbol symbol, const Term* args) {
+    return d->symbol.sort() == symbol.sort() && d->symbol == symbol &&
+        std::equal(args, args + symbol.arity(), d->args());
+  }
 
   Factory() = default;
   Factory(const Factory&) = delete;
@@ -287,10 +433,53 @@ class Term::Factory : private Singleton<Factory> {
   Factory(Factory&&) = delete;
   Factory& operator=(Factory&&) = delete;
 
-  typedef std::unordered_map<Data*, u32, DataPtrHash, DataPtrEquals> DataPtrSet;
-  internal::IntMap<Symbol::Sort, DataPtrSet> memory_;
-  std::vector<Data*> name_heap_;
-  std::vector<Data*> variable_and_function_heap_;
+  u32 Find(const Table& table, internal::hash32_t h, Symbol symbol, const Term* args) const {
+    u32 id;
+    for (size_t i = h & table.mask; (id = table.slots[i].load(std::memory_order_acquire)) != 0; i = (i + 1) & table.mask) {
+      if (Equals(get(id), symbol, args)) {
+        return id;
+      }
+    }
+    return 0;
+  }
+
+  static Data* Allocate(Shard* shard, Symbol symbol, const Term* args) {
+    const size_t n_words = sizeof(Data) / sizeof(u32) + symbol.arity();
+    if (shard->chunk_used + n_words > kChunkSize || shard->chunks.empty()) {
+      shard->chunks.push_back(std::unique_ptr<u32[]>(new u32[kChunkSize]));
+      shard->chunk_used = 0;
+    }
+    u32* memory = shard->chunks.back().get() + shard->chunk_used;
+    shard->chunk_used += n_words;
+    Data* d = new (memory) Data(symbol, flags(symbol, args));
+    Term* d_args = reinterpret_cast<Term*>(d + 1);
+    for (Symbol::Arity i = 0; i < symbol.arity(); ++i) {
+      new (d_args + i) Term(args[i]);
+    }
+    return d;
+  }
+
+  void Rehash(Shard* shard) {
+    const Table* old_table = shard->table.load(std::memory_order_relaxed);
+    std::unique_ptr<Table> table(new Table(2 * (old_table->mask + 1)));
+    for (size_t j = 0; j <= old_table->mask; ++j) {
+      const u32 id = old_table->slots[j].load(std::memory_order_relaxed);
+      if (id != 0) {
+        const Data* d = get(id);
+        size_t i = hash(d->symbol, d->args()) & table->mask;
+        while (table->slots[i].load(std::memory_order_relaxed) != 0) {
+          i = (i + 1) & table->mask;
+        }
+        table->slots[i].store(id, std::memory_order_relaxed);
+      }
+    }
+    shard->table.store(table.get(), std::memory_order_release);
+    shard->tables.push_back(std::move(table));
+  }
+
+  Shard shards_[1 << kShardBits];
+  Heap name_heap_;
+  Heap variable_and_function_heap_;
 };
 
 struct Term::Substitution {
@@ -319,16 +508,20 @@ struct Term::Substitution {
   std::vector<std::pair<Term, Term>> subs_;
 };
 
-inline Symbol Term::symbol()            const { return data()->symbol; }
-inline Term Term::arg(size_t i)         const { return data()->args[i]; }
-inline const Term::Vector& Term::args() const { return data()->args; }
-inline const Term::Data* Term::data()   const { return Factory::Instance()->get(id_); }
+inline Symbol Term::symbol()          const { return data()->symbol; }
+inline Term Term::arg(size_t i)       const { return data()->args()[i]; }
+inline Term::Args Term::args()        const { const Data* d = data(); return Args(d->args(), d->args() + d->symbol.arity()); }
+inline const Term::Data* Term::data() const { return Factory::Instance()->get(id_); }
+
+inline bool Term::ground()         const { return name() || (data()->flags & Data::kGround) != 0; }
+inline bool Term::primitive()      const { return (data()->flags & Data::kPrimitive) != 0; }
+inline bool Term::quasiprimitive() const { return (data()->flags & Data::kQuasiprimitive) != 0; }
 
 template<typename UnaryPredicate>
-inline bool Term::all_args(UnaryPredicate p) const { return std::all_of(data()->args.begin(), data()->args.end(), p); }
+inline bool Term::all_args(UnaryPredicate p) const { const Args a = args(); return std::all_of(a.begin(), a.end(), p); }
 
 template<typename UnaryPredicate>
-inline bool Term::any_arg(UnaryPredicate p) const { return std::any_of(data()->args.begin(), data()->args.end(), p); }
+inline bool Term::any_arg(UnaryPredicate p) const { const Args a = args(); return std::any_of(a.begin(), a.end(), p); }
 
 template<typename UnaryFunction>
 Term Term::Substitute(UnaryFunction theta, Factory* tf) const {
@@ -336,13 +529,14 @@ Term Term::Substitute(UnaryFunction theta, Factory* tf) const {
   if (t) {
     return t.val;
   } else if (arity() > 0) {
+    const Args old_args = this->args();
     Vector args;
-    args.reserve(data()->args.size());
-    for (Term arg : data()->args) {
+    args.reserve(old_args.size());
+    for (Term arg : old_args) {
       args.push_back(arg.Substitute(theta, tf));
     }
-    if (args != data()->args) {
-      return tf->CreateTerm(data()->symbol, args);
+    if (!std::equal(args.begin(), args.end(), old_args.begin())) {
+      return tf->CreateTerm(symbol(), args);
     } else {
       return *this;
     }
@@ -292,9 +292,9 @@ TEST(GrounderTest, Ground_SplitTerms_Names) {
       EXPECT_EQ(unique_length(*s), 1);
       EXPECT_TRUE(bool(g.setup_));
     }
-    g.PrepareForQuery(0, *phi);  // adds new plus name, re-ground everything
+    g.PrepareForQuery(0, *phi);  // adds new plus name only for the query, no re-grounding
     {
-      EXPECT_TRUE(g.names_changed_);
+      EXPECT_FALSE(g.names_changed_);
       EXPECT_EQ(g.unprocessed_clauses_.size(), 0);
       EXPECT_EQ(g.processed_clauses_.size(), 1);
       const class Setup* s = &g.Ground();
@@ -407,9 +407,64 @@ TEST(GrounderTest, Assignments) {
     ts.insert(n3);
     Grounder::Assignments as({x1,x2,x3}, &ts);
     EXPECT_EQ(length(as), 4);
+    EXPECT_EQ(as.size(), 4);
+    // the chunks partition the assignments
+    std::vector<std::vector<Term>> all;
+    for (size_t first = 0; first < as.size(); first += 3) {
+      for (const Grounder::Assignments::Assignment& a : as.chunk(first, std::min(first + 3, as.size()))) {
+        std::vector<Term> values;
+        for (size_t i = 0; i < a.vars().size(); ++i) {
+          EXPECT_EQ(a(a.vars()[i]).val, a[i]);
+          EXPECT_EQ(a[i].sort(), a.vars()[i].sort());
+          values.push_back(a[i]);
+        }
+        all.push_back(values);
+      }
+    }
+    EXPECT_EQ(all.size(), 4);
+    std::sort(all.begin(), all.end());
+    EXPECT_TRUE(std::unique(all.begin(), all.end()) == all.end());
+    EXPECT_EQ(length(as.chunk(1, 1)), 0);
   }
 }
 
+TEST(GrounderTest, LiteralAssignments) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort();                  RegisterSort(s1, "");
+  const Term n1 = tf.CreateTerm(sf.CreateName(s1));         RegisterSymbol(n1.symbol(), "n1");
+  const Term n2 = tf.CreateTerm(sf.CreateName(s1));         RegisterSymbol(n2.symbol(), "n2");
+  const Term x1 = tf.CreateTerm(sf.CreateVariable(s1));     RegisterSymbol(x1.symbol(), "x1");
+  const Symbol f = sf.CreateFunction(s1, 1);                RegisterSymbol(f, "f");
+
+  Grounder g(&sf, &tf);
+  g.AddClause(Clause({Literal::Neq(tf.CreateTerm(f, {x1}), n1), Literal::Neq(tf.CreateTerm(f, {x1}), n2)}));
+  g.Ground();
+  const size_t n_names = g.Names()[s1].size();
+  EXPECT_GE(n_names, 3);
+  // Every literal f(n) = m is an assignment, and for every m the literals
+  // with n != m form a class of isomorphic literals.
+  const Grounder::LiteralAssignmentSet sets = g.LiteralAssignments();
+  std::unordered_set<Literal, Literal::LhsHash> singletons;
+  std::vector<size_t> class_sizes;
+  for (const Grounder::LiteralAssignmentSet::Literals lits : sets) {
+    ASSERT_FALSE(lits.empty());
+    if (lits.size() == 1) {
+      EXPECT_TRUE(singletons.insert(*lits.begin()).second);
+      continue;
+    }
+    const Literal a = *lits.begin();
+    for (const Literal b : lits) {
+      EXPECT_EQ(b.lhs().symbol(), f);
+      EXPECT_EQ(b.rhs(), a.rhs());
+      EXPECT_NE(b.lhs().arg(0), b.rhs());
+    }
+    class_sizes.push_back(lits.size());
+  }
+  EXPECT_EQ(singletons.size(), n_names * n_names);
+  EXPECT_EQ(class_sizes, std::vector<size_t>(n_names, n_names - 1));
+}
+
 TEST(GrounderTest, Ground_SplitNames) {
   Symbol::Factory& sf = *Symbol::Factory::Instance();
   Term::Factory& tf = *Term::Factory::Instance();
@@ -530,5 +585,347 @@ TEST(GrounderTest, Ground_SplitNames_iterated) {
   }
 }
 
-}  // namespace limbo
+TEST(GrounderTest, Ground_new_names) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort Bool = sf.CreateSort();                            RegisterSort(Bool, "");
+  const Symbol::Sort Human = sf.CreateSort();                           RegisterSort(Human, "");
+  //
+  const Term T          = tf.CreateTerm(sf.CreateName(Bool));           RegisterSymbol(T.symbol(), "T");
+  const Term n1         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n1.symbol(), "n1");
+  const Term n2         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n2.symbol(), "n2");
+  const Term x          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(x.symbol(), "x");
+  const Term y          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(y.symbol(), "y");
+  //
+  const Symbol P        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(P, "P");
+  const Symbol Q        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(Q, "Q");
+  const Symbol R        = sf.CreateFunction(Bool, 2);                   RegisterSymbol(R, "R");
+  auto p = [&tf, P](Term t) { return tf.CreateTerm(P, {t}); };
+  auto q = [&tf, Q](Term t) { return tf.CreateTerm(Q, {t}); };
+  auto r = [&tf, R](Term t1, Term t2) { return tf.CreateTerm(R, {t1, t2}); };
+  //
+  Grounder g(&sf, &tf);
+  g.AddClause(Clause({ Literal::Eq(p(x), T), Literal::Eq(q(x), T) }));
+  g.AddClause(Clause({ Literal::Eq(r(x, y), T), Literal::Neq(r(y, x), T) }));
+  const size_t n_old = g.Names()[Human].size();
+  EXPECT_FALSE(g.Names().contains(n2));
+  EXPECT_EQ(unique_length(g.Ground()), n_old + n_old * (n_old - 1));
+  // n2 is new, so only the instances mentioning n2 need to be grounded
+  g.PrepareForQuery(0, *Formula::Factory::Atomic(Clause({ Literal::Eq(p(n2), T) })));
+  const size_t n_new = g.Names()[Human].size();
+  EXPECT_TRUE(g.Names().contains(n2));
+  EXPECT_GT(n_new, n_old);
+  const std::unordered_set<Clause> cs = unique(g.Ground());
+  EXPECT_EQ(cs.size(), n_new + n_new * (n_new - 1));
+  EXPECT_EQ(cs.count(Clause({ Literal::Eq(p(n2), T), Literal::Eq(q(n2), T) })), 1);
+  for (Term n : g.Names()[Human]) {
+    if (n != n2) {
+      EXPECT_EQ(cs.count(Clause({ Literal::Eq(r(n, n2), T), Literal::Neq(r(n2, n), T) })), 1);
+      EXPECT_EQ(cs.count(Clause({ Literal::Eq(r(n2, n), T), Literal::Neq(r(n, n2), T) })), 1);
+    }
+  }
+  // nothing changed, so nothing is grounded
+  EXPECT_EQ(unique_length(g.Ground()), cs.size());
+}
+
+TEST(GrounderTest, Ground_query_names) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort Bool = sf.CreateSort();                            RegisterSort(Bool, "");
+  const Symbol::Sort Human = sf.CreateSort();                           RegisterSort(Human, "");
+  //
+  const Term T          = tf.CreateTerm(sf.CreateName(Bool));           RegisterSymbol(T.symbol(), "T");
+  const Term x          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(x.symbol(), "x");
+  const Term y          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(y.symbol(), "y");
+  const Term z          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(z.symbol(), "z");
+  //
+  const Symbol P        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(P, "P");
+  const Symbol Q        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(Q, "Q");
+  auto p = [&tf, P](Term t) { return tf.CreateTerm(P, {t}); };
+  auto q = [&tf, Q](Term t) { return tf.CreateTerm(Q, {t}); };
+  //
+  Grounder g(&sf, &tf);
+  g.AddClause(Clause({ Literal::Eq(p(x), T), Literal::Eq(q(x), T) }));
+  const size_t n_kb = g.Names()[Human].size();
+  EXPECT_EQ(unique_length(g.Ground()), n_kb);
+  auto phi = Formula::Factory::Exists(x, Formula::Factory::Exists(y, Formula::Factory::Exists(z,
+      Formula::Factory::Atomic(Clause({ Literal::Eq(p(x), T), Literal::Eq(p(y), T), Literal::Eq(p(z), T) })))));
+  Grounder::TermSet query_names;
+  for (int i = 0; i < 3; ++i) {
+    g.PrepareForQuery(0, *phi);
+    const size_t n_query = g.Names()[Human].size();
+    EXPECT_GT(n_query, n_kb);
+    EXPECT_EQ(unique_length(g.Ground()), n_query);
+    if (i == 0) {
+      query_names = g.Names()[Human];
+    } else {
+      EXPECT_EQ(g.Names()[Human], query_names);
+    }
+    // the temporary names and clauses are gone after the query
+    g.EndQuery();
+    EXPECT_EQ(g.Names()[Human].size(), n_kb);
+    EXPECT_EQ(unique_length(g.Ground()), n_kb);
+  }
+}
 
+TEST(GrounderTest, Ground_lazy) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort Bool = sf.CreateSort();                            RegisterSort(Bool, "");
+  const Symbol::Sort Human = sf.CreateSort();                           RegisterSort(Human, "");
+  //
+  const Term T          = tf.CreateTerm(sf.CreateName(Bool));           RegisterSymbol(T.symbol(), "T");
+  const Term n1         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n1.symbol(), "n1");
+  const Term n2         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n2.symbol(), "n2");
+  const Term n3         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n3.symbol(), "n3");
+  const Term x          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(x.symbol(), "x");
+  const Term y          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(y.symbol(), "y");
+  //
+  const Symbol R        = sf.CreateFunction(Bool, 2);                   RegisterSymbol(R, "R");
+  const Symbol S        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(S, "S");
+  const Symbol Q        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(Q, "Q");
+  auto r = [&tf, R](Term t1, Term t2) { return tf.CreateTerm(R, {t1, t2}); };
+  auto s = [&tf, S](Term t) { return tf.CreateTerm(S, {t}); };
+  auto q = [&tf, Q](Term t) { return tf.CreateTerm(Q, {t}); };
+  //
+  Grounder g(&sf, &tf);
+  g.set_lazy_grounding(true);
+  g.AddClause(Clause({ Literal::Eq(r(x, y), T), Literal::Eq(s(y), T) }));
+  g.AddClause(Clause({ Literal::Eq(s(n1), T), Literal::Eq(s(n2), T) }));
+  EXPECT_EQ(unique_length(g.Ground()), 0);
+  // S(n3) only interacts with the instances for y = n3
+  g.PrepareForQuery(0, *Formula::Factory::Atomic(Clause({ Literal::Eq(s(n3), T) })));
+  const size_t n = g.Names()[Human].size();
+  EXPECT_EQ(unique_length(g.Ground()), n);
+  // S(n1) also interacts with S(n2) and thus with the instances for y = n1 and y = n2
+  g.PrepareForQuery(0, *Formula::Factory::Atomic(Clause({ Literal::Eq(s(n1), T) })));
+  EXPECT_EQ(unique_length(g.Ground()), 3*n + 1);
+  // a new name is grounded for the terms grounded already
+  const Term n4 = tf.CreateTerm(sf.CreateName(Human));                  RegisterSymbol(n4.symbol(), "n4");
+  g.AddClause(Clause({ Literal::Eq(q(n4), T) }));
+  EXPECT_EQ(unique_length(g.Ground()), 3*(n+1) + 1);
+  // the eager grounding is a superset
+  g.set_lazy_grounding(false);
+  EXPECT_EQ(unique_length(g.Ground()), (n+1)*(n+1) + 2);
+}
+
+TEST(GrounderTest, Ground_base) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort Bool = sf.CreateSort();                            RegisterSort(Bool, "");
+  const Symbol::Sort Human = sf.CreateSort();                           RegisterSort(Human, "");
+  //
+  const Term T          = tf.CreateTerm(sf.CreateName(Bool));           RegisterSymbol(T.symbol(), "T");
+  const Term n1         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n1.symbol(), "n1");
+  const Term n2         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n2.symbol(), "n2");
+  const Term x          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(x.symbol(), "x");
+  //
+  const Symbol P        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(P, "P");
+  const Symbol Q        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(Q, "Q");
+  auto p = [&tf, P](Term t) { return tf.CreateTerm(P, {t}); };
+  auto q = [&tf, Q](Term t) { return tf.CreateTerm(Q, {t}); };
+  //
+  Grounder base(&sf, &tf);
+  Grounder g1(&sf, &tf);
+  Grounder g2(&sf, &tf);
+  g1.set_base(&base);
+  g2.set_base(&base);
+  base.AddClause(Clause({ Literal::Eq(p(x), T), Literal::Eq(q(x), T) }));
+  g1.AddClause(Clause({ Literal::Neq(q(n1), T) }));
+  g2.AddClause(Clause({ Literal::Neq(p(n2), T) }));
+  const size_t n_kb = base.Names()[Human].size();
+  EXPECT_EQ(unique_length(base.Ground()), n_kb);
+  EXPECT_EQ(g1.Names()[Human].size(), n_kb + 1);
+  EXPECT_EQ(g2.Names()[Human].size(), n_kb + 1);
+  for (int i = 0; i < 2; ++i) {
+    // n1 is new to the base, so the layer grounds the base's clause for it
+    const limbo::Setup& s1 = g1.Ground();
+    EXPECT_EQ(unique_length(s1), n_kb + 2);
+    EXPECT_TRUE(s1.Subsumes(Clause({ Literal::Eq(p(n1), T) })));
+    EXPECT_FALSE(s1.Subsumes(Clause({ Literal::Eq(q(n2), T) })));
+    const limbo::Setup& s2 = g2.Ground();
+    EXPECT_EQ(unique_length(s2), n_kb + 2);
+    EXPECT_TRUE(s2.Subsumes(Clause({ Literal::Eq(q(n2), T) })));
+    EXPECT_FALSE(s2.Subsumes(Clause({ Literal::Eq(p(n1), T) })));
+  }
+  // the layers are gone when the base is grounded on its own
+  EXPECT_EQ(unique_length(base.Ground()), n_kb);
+  // new clauses of the base show up in the layers
+  base.AddClause(Clause({ Literal::Eq(q(n2), T) }));
+  EXPECT_EQ(g1.Names()[Human].size(), n_kb + 2);
+  EXPECT_TRUE(g1.Ground().Subsumes(Clause({ Literal::Eq(q(n2), T) })));
+  EXPECT_TRUE(g1.Ground().Subsumes(Clause({ Literal::Eq(p(n1), T) })));
+}
+
+TEST(GrounderTest, Ground_base_private) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort Bool = sf.CreateSort();                            RegisterSort(Bool, "");
+  const Symbol::Sort Human = sf.CreateSort();                           RegisterSort(Human, "");
+  //
+  const Term T          = tf.CreateTerm(sf.CreateName(Bool));           RegisterSymbol(T.symbol(), "T");
+  const Term n1         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n1.symbol(), "n1");
+  const Term n2         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n2.symbol(), "n2");
+  const Term x          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(x.symbol(), "x");
+  //
+  const Symbol P        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(P, "P");
+  const Symbol Q        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(Q, "Q");
+  auto p = [&tf, P](Term t) { return tf.CreateTerm(P, {t}); };
+  auto q = [&tf, Q](Term t) { return tf.CreateTerm(Q, {t}); };
+  //
+  Grounder base(&sf, &tf);
+  Grounder g1(&sf, &tf);
+  Grounder g2(&sf, &tf);
+  g1.set_base(&base);
+  g2.set_base(&base);
+  g1.set_private_layer(true);
+  g2.set_private_layer(true);
+  base.AddClause(Clause({ Literal::Eq(p(x), T), Literal::Eq(q(x), T) }));
+  g1.AddClause(Clause({ Literal::Neq(q(n1), T) }));
+  g2.AddClause(Clause({ Literal::Neq(p(n2), T) }));
+  const size_t n_kb = base.Names()[Human].size();
+  EXPECT_EQ(unique_length(base.Ground()), n_kb);
+  // both layers' Setups are alive at the same time, and the base is unchanged
+  const limbo::Setup& s1 = g1.Ground();
+  const limbo::Setup& s2 = g2.Ground();
+  EXPECT_NE(&s1, &s2);
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(unique_length(s1), n_kb + 2);
+    EXPECT_TRUE(s1.Subsumes(Clause({ Literal::Eq(p(n1), T) })));
+    EXPECT_FALSE(s1.Subsumes(Clause({ Literal::Eq(q(n2), T) })));
+    EXPECT_EQ(unique_length(s2), n_kb + 2);
+    EXPECT_TRUE(s2.Subsumes(Clause({ Literal::Eq(q(n2), T) })));
+    EXPECT_FALSE(s2.Subsumes(Clause({ Literal::Eq(p(n1), T) })));
+    EXPECT_EQ(&g1.Ground(), &s1);
+    EXPECT_EQ(&g2.Ground(), &s2);
+  }
+  EXPECT_EQ(unique_length(base.Ground()), n_kb);
+  EXPECT_FALSE(base.Ground().Subsumes(Clause({ Literal::Neq(q(n1), T) })));
+  // new clauses of the base show up in the layers
+  base.AddClause(Clause({ Literal::Eq(q(n2), T) }));
+  EXPECT_TRUE(g1.Ground().Subsumes(Clause({ Literal::Eq(q(n2), T) })));
+  EXPECT_TRUE(g1.Ground().Subsumes(Clause({ Literal::Eq(p(n1), T) })));
+  EXPECT_TRUE(g2.Ground().Subsumes(Clause({ Literal::Eq(q(n2), T) })));
+  EXPECT_TRUE(g2.Ground().Subsumes(Clause({ Literal::Neq(p(n2), T) })));
+}
+
+TEST(GrounderTest, Ground_parallel) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort Bool = sf.CreateSort();                            RegisterSort(Bool, "");
+  const Symbol::Sort Human = sf.CreateSort();                           RegisterSort(Human, "");
+  //
+  const Term T          = tf.CreateTerm(sf.CreateName(Bool));           RegisterSymbol(T.symbol(), "T");
+  const Term n1         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n1.symbol(), "n1");
+  const Term n2         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n2.symbol(), "n2");
+  const Term n3         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n3.symbol(), "n3");
+  const Term x          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(x.symbol(), "x");
+  const Term y          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(y.symbol(), "y");
+  const Term z          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(z.symbol(), "z");
+  //
+  const Symbol R        = sf.CreateFunction(Bool, 2);                   RegisterSymbol(R, "R");
+  const Symbol S        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(S, "S");
+  const Symbol F        = sf.CreateFunction(Human, 1);                  RegisterSymbol(F, "F");
+  auto r = [&tf, R](Term t1, Term t2) { return tf.CreateTerm(R, {t1, t2}); };
+  auto s = [&tf, S](Term t) { return tf.CreateTerm(S, {t}); };
+  auto f = [&tf, F](Term t) { return tf.CreateTerm(F, {t}); };
+  // The plus names differ between the two Grounders, so only the instances
+  // over the explicit names are compared.
+  auto explicit_instances = [n1, n2, n3](const limbo::Setup& setup) {
+    std::unordered_set<Clause> set;
+    for (const Clause& c : unique(setup)) {
+      bool only_explicit_names = true;
+      c.Traverse([n1, n2, n3, &only_explicit_names](Term t) {
+        only_explicit_names &= !t.name() || t.sort() != n1.sort() || t == n1 || t == n2 || t == n3;
+        return true;
+      });
+      if (only_explicit_names) {
+        set.insert(c);
+      }
+    }
+    return set;
+  };
+  //
+  internal::ThreadPool pool(3);
+  Grounder gs(&sf, &tf);
+  Grounder gp(&sf, &tf);
+  gp.set_thread_pool(&pool);
+  for (Grounder* g : {&gs, &gp}) {
+    g->AddClause(Clause({ Literal::Eq(r(x, y), T), Literal::Eq(s(y), T), Literal::Neq(f(z), x) }));
+    g->AddClause(Clause({ Literal::Eq(s(n1), T), Literal::Eq(f(x), n2) }));
+  }
+  EXPECT_EQ(unique_length(gs.Ground()), unique_length(gp.Ground()));
+  EXPECT_EQ(explicit_instances(gs.Ground()), explicit_instances(gp.Ground()));
+  EXPECT_GT(explicit_instances(gp.Ground()).size(), 0);
+  // the new name is grounded incrementally, and so are the query names
+  for (Grounder* g : {&gs, &gp}) {
+    g->AddClause(Clause({ Literal::Eq(s(n3), T) }));
+    g->PrepareForQuery(0, *Formula::Factory::Exists(x, Formula::Factory::Atomic(Clause({ Literal::Eq(r(x, n3), T) }))));
+  }
+  EXPECT_EQ(unique_length(gs.Ground()), unique_length(gp.Ground()));
+  EXPECT_EQ(explicit_instances(gs.Ground()), explicit_instances(gp.Ground()));
+  for (Grounder* g : {&gs, &gp}) {
+    g->EndQuery();
+  }
+  EXPECT_EQ(unique_length(gs.Ground()), unique_length(gp.Ground()));
+  EXPECT_EQ(explicit_instances(gs.Ground()), explicit_instances(gp.Ground()));
+}
+
+
+TEST(GrounderTest, Ground_template) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort Bool = sf.CreateSort();                            RegisterSort(Bool, "");
+  const Symbol::Sort Human = sf.CreateSort();                           RegisterSort(Human, "");
+  //
+  const Term T          = tf.CreateTerm(sf.CreateName(Bool));           RegisterSymbol(T.symbol(), "T");
+  const Term n1         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n1.symbol(), "n1");
+  const Term n2         = tf.CreateTerm(sf.CreateName(Human));          RegisterSymbol(n2.symbol(), "n2");
+  const Term x          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(x.symbol(), "x");
+  const Term y          = tf.CreateTerm(sf.CreateVariable(Human));      RegisterSymbol(y.symbol(), "y");
+  //
+  const Symbol P        = sf.CreateFunction(Bool, 2);                   RegisterSymbol(P, "P");
+  const Symbol R        = sf.CreateFunction(Bool, 2);                   RegisterSymbol(R, "R");
+  const Symbol S        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(S, "S");
+  const Symbol Q        = sf.CreateFunction(Bool, 1);                   RegisterSymbol(Q, "Q");
+  const Symbol U        = sf.CreateFunction(Bool, 2);                   RegisterSymbol(U, "U");
+  auto p = [&tf, P](Term t1, Term t2) { return tf.CreateTerm(P, {t1, t2}); };
+  auto r = [&tf, R](Term t1, Term t2) { return tf.CreateTerm(R, {t1, t2}); };
+  auto s = [&tf, S](Term t) { return tf.CreateTerm(S, {t}); };
+  auto q = [&tf, Q](Term t) { return tf.CreateTerm(Q, {t}); };
+  // The instances of the first clause are valid unless x = y. The second one
+  // is longer than the inline array of a Clause, and its instances for x = y
+  // have duplicate literals.
+  const Clause c1({ Literal::Neq(x, y), Literal::Eq(p(x, y), T) });
+  const Clause c2({ Literal::Eq(r(x, y), T), Literal::Eq(r(y, x), T), Literal::Eq(s(x), T),
+                    Literal::Eq(s(y), T), Literal::Eq(q(x), T), Literal::Eq(q(y), T) });
+  Grounder g(&sf, &tf);
+  g.AddClause(c1);
+  g.AddClause(c2);
+  g.AddClause(Clause({ Literal::Eq(tf.CreateTerm(U, {n1, n2}), T) }));
+  const std::unordered_set<Clause> instances = unique(g.Ground());
+  // The instances match those from Clause::Substitute().
+  std::unordered_set<Clause> expected;
+  expected.insert(Clause({ Literal::Eq(tf.CreateTerm(U, {n1, n2}), T) }));
+  for (const Term nx : g.Names()[Human]) {
+    for (const Term ny : g.Names()[Human]) {
+      auto theta = [x, y, nx, ny](Term t) {
+        return t == x ? internal::Just(nx) : t == y ? internal::Just(ny) : internal::Maybe<Term>();
+      };
+      for (const Clause& c : {c1, c2}) {
+        const Clause d = c.Substitute(theta, &tf);
+        if (!d.valid()) {
+          expected.insert(d);
+        }
+      }
+    }
+  }
+  EXPECT_EQ(instances, expected);
+  EXPECT_TRUE(instances.count(Clause({ Literal::Eq(p(n1, n1), T) })) > 0);
+  EXPECT_TRUE(instances.count(Clause({ Literal::Eq(r(n1, n1), T), Literal::Eq(s(n1), T), Literal::Eq(q(n1), T) })) > 0);
+  for (const Clause& c : instances) {
+    EXPECT_FALSE(c.any([&](Literal a) { return a.lhs() == p(n1, n2) || a.lhs() == p(n2, n1); }));
+  }
+}
+
+}  // namespace limbo
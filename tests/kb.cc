@@ -74,5 +74,121 @@ TEST(KnowledgeBaseTest, ECAI2016Sound_NoGuarantee) {
   EXPECT_TRUE(kb.Entails(*Formula::Factory::Bel(1, 1, *(Italian != T), *(Veggie != T))));
 }
 
+TEST(KnowledgeBaseTest, ECAI2016Sound_incremental) {
+  Context ctx;
+  KnowledgeBase kb_inc(ctx.sf(), ctx.tf());
+  KnowledgeBase kb_all(ctx.sf(), ctx.tf());
+  kb_inc.set_incremental_spheres(true);
+  auto Bool = ctx.CreateSort();                   RegisterSort(Bool, "");
+  auto Food = ctx.CreateSort();                   RegisterSort(Food, "");
+  auto T = ctx.CreateName(Bool);                  REGISTER_SYMBOL(T);
+  auto Aussie = ctx.CreateFunction(Bool, 0)();    REGISTER_SYMBOL(Aussie);
+  auto Italian = ctx.CreateFunction(Bool, 0)();   REGISTER_SYMBOL(Italian);
+  auto Eats = ctx.CreateFunction(Bool, 1);        REGISTER_SYMBOL(Eats);
+  auto Meat = ctx.CreateFunction(Bool, 1);        REGISTER_SYMBOL(Meat);
+  auto Veggie = ctx.CreateFunction(Bool, 0)();    REGISTER_SYMBOL(Veggie);
+  auto roo = ctx.CreateName(Food);                REGISTER_SYMBOL(roo);
+  auto x = ctx.CreateVariable(Food);              REGISTER_SYMBOL(x);
+  Formula::split_level k = 1;
+  Formula::split_level l = 1;
+  std::vector<Formula::Ref> beliefs;
+  beliefs.push_back(Formula::Factory::Bel(k, l, *(Aussie == T), *(Italian != T)));
+  beliefs.push_back(Formula::Factory::Bel(k, l, *(Italian == T), *(Aussie != T)));
+  beliefs.push_back(Formula::Factory::Bel(k, l, *(Aussie == T), *(Eats(roo) == T)));
+  beliefs.push_back(Formula::Factory::Bel(k, l, *(T == T), *(Italian == T || Veggie == T)));
+  beliefs.push_back(Formula::Factory::Bel(k, l, *(Italian != T), *(Aussie == T)));
+  beliefs.push_back(Formula::Factory::Bel(k, l, *(Meat(roo) != T), *(T != T)));
+  beliefs.push_back(Formula::Factory::Bel(k, l, *(~Fa(x, (Veggie == T && Meat(x) == T) >> (Eats(x) != T))), *(T != T)));
+  std::vector<Formula::Ref> queries;
+  queries.push_back(Formula::Factory::Bel(1, 1, *(Italian != T), *(Veggie != T)));
+  queries.push_back(Formula::Factory::Bel(1, 1, *(Aussie == T), *(Eats(roo) == T)));
+  queries.push_back(Formula::Factory::Bel(1, 1, *(T == T), *(Aussie != T)));
+  for (const Formula::Ref& alpha : beliefs) {
+    EXPECT_TRUE(kb_inc.Add(*alpha));
+    EXPECT_TRUE(kb_all.Add(*alpha));
+    for (const Formula::Ref& beta : queries) {
+      EXPECT_EQ(kb_inc.Entails(*beta), kb_all.Entails(*beta));
+    }
+    EXPECT_EQ(kb_inc.n_spheres(), kb_all.n_spheres());
+  }
+  EXPECT_TRUE(kb_inc.Entails(*Formula::Factory::Bel(1, 1, *(Italian != T), *(Veggie != T))));
+  EXPECT_FALSE(kb_inc.Entails(*Formula::Factory::Bel(1, 0, *(Italian != T), *(Veggie != T))));
+}
+
+TEST(KnowledgeBaseTest, ECAI2016Sound_threads) {
+  Context ctx;
+  KnowledgeBase kb_par(ctx.sf(), ctx.tf());
+  KnowledgeBase kb_seq(ctx.sf(), ctx.tf());
+  kb_par.set_threads(4);
+  auto Bool = ctx.CreateSort();                   RegisterSort(Bool, "");
+  auto Food = ctx.CreateSort();                   RegisterSort(Food, "");
+  auto T = ctx.CreateName(Bool);                  REGISTER_SYMBOL(T);
+  auto Aussie = ctx.CreateFunction(Bool, 0)();    REGISTER_SYMBOL(Aussie);
+  auto Italian = ctx.CreateFunction(Bool, 0)();   REGISTER_SYMBOL(Italian);
+  auto Eats = ctx.CreateFunction(Bool, 1);        REGISTER_SYMBOL(Eats);
+  auto Meat = ctx.CreateFunction(Bool, 1);        REGISTER_SYMBOL(Meat);
+  auto Veggie = ctx.CreateFunction(Bool, 0)();    REGISTER_SYMBOL(Veggie);
+  auto roo = ctx.CreateName(Food);                REGISTER_SYMBOL(roo);
+  auto x = ctx.CreateVariable(Food);              REGISTER_SYMBOL(x);
+  Formula::split_level k = 1;
+  Formula::split_level l = 1;
+  std::vector<Formula::Ref> alphas;
+  alphas.push_back(Formula::Factory::Bel(k, l, *(Aussie == T), *(Italian != T)));
+  alphas.push_back(Formula::Factory::Bel(k, l, *(Italian == T), *(Aussie != T)));
+  alphas.push_back(Formula::Factory::Bel(k, l, *(Aussie == T), *(Eats(roo) == T)));
+  alphas.push_back(Formula::Factory::Bel(k, l, *(T == T), *(Italian == T || Veggie == T)));
+  alphas.push_back(Formula::Factory::Bel(k, l, *(Italian != T), *(Aussie == T)));
+  alphas.push_back(Formula::Factory::Bel(k, l, *(Meat(roo) != T), *(T != T)));
+  alphas.push_back(Formula::Factory::Bel(k, l, *(~Fa(x, (Veggie == T && Meat(x) == T) >> (Eats(x) != T))), *(T != T)));
+  alphas.push_back(Formula::Factory::Know(0, *(Aussie == T || Italian == T)));
+  std::vector<Formula::Ref> queries;
+  queries.push_back(Formula::Factory::Bel(1, 1, *(Italian != T), *(Veggie != T)));
+  queries.push_back(Formula::Factory::Bel(1, 0, *(Italian != T), *(Veggie != T)));
+  queries.push_back(Formula::Factory::Bel(1, 1, *(Aussie == T), *(Eats(roo) == T)));
+  queries.push_back(Formula::Factory::Bel(1, 1, *(T == T), *(Aussie != T)));
+  queries.push_back(Formula::Factory::Bel(1, 1, *(T == T), *(Aussie == T || Italian == T)));
+  for (const Formula::Ref& alpha : alphas) {
+    EXPECT_TRUE(kb_par.Add(*alpha));
+    EXPECT_TRUE(kb_seq.Add(*alpha));
+    for (const Formula::Ref& beta : queries) {
+      EXPECT_EQ(kb_par.Entails(*beta), kb_seq.Entails(*beta));
+    }
+    EXPECT_EQ(kb_par.n_spheres(), kb_seq.n_spheres());
+  }
+  EXPECT_TRUE(kb_par.Entails(*Formula::Factory::Bel(1, 1, *(Italian != T), *(Veggie != T))));
+  EXPECT_FALSE(kb_par.Entails(*Formula::Factory::Bel(1, 0, *(Italian != T), *(Veggie != T))));
+  EXPECT_TRUE(kb_par.Entails(*Formula::Factory::Bel(1, 1, *(T == T), *(Aussie == T || Italian == T))));
+}
+
+TEST(KnowledgeBaseTest, QuantifyingIn) {
+  Context ctx;
+  KnowledgeBase kb(ctx.sf(), ctx.tf());
+  auto Human = ctx.CreateSort();                  RegisterSort(Human, "");
+  auto alice = ctx.CreateName(Human);             REGISTER_SYMBOL(alice);
+  auto bob = ctx.CreateName(Human);               REGISTER_SYMBOL(bob);
+  auto carol = ctx.CreateName(Human);             REGISTER_SYMBOL(carol);
+  auto Father = ctx.CreateFunction(Human, 1);     REGISTER_SYMBOL(Father);
+  auto x = ctx.CreateVariable(Human);             REGISTER_SYMBOL(x);
+  auto y = ctx.CreateVariable(Human);             REGISTER_SYMBOL(y);
+  auto z = ctx.CreateVariable(Human);             REGISTER_SYMBOL(z);
+  EXPECT_TRUE(kb.Add(*Formula::Factory::Know(0, *(Father(alice) == bob))));
+  Formula::Ref father = *Ex(x, Ex(y, Formula::Factory::Know(0, *(Father(x) == y))));
+  Formula::Ref father_of_bob = *Ex(y, Formula::Factory::Know(0, *(Father(bob) == y)));
+  Formula::Ref grandfather = *Ex(x, Ex(y, Ex(z, Formula::Factory::Know(0, *(Father(x) == y && Father(y) == z)))));
+  Formula::Ref cycle = *Ex(x, Ex(y, Ex(z, Formula::Factory::Know(0, *(Father(x) == y && Father(y) == z &&
+                                                                         Father(z) == x)))));
+  Formula::Ref possible = *Ex(x, Fa(y, Formula::Factory::Cons(1, *(Father(x) != y))));
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE(kb.Entails(*father));
+    EXPECT_FALSE(kb.Entails(*father_of_bob));
+    EXPECT_FALSE(kb.Entails(*grandfather));
+    EXPECT_TRUE(kb.Entails(*possible));
+  }
+  EXPECT_TRUE(kb.Add(*Formula::Factory::Know(0, *(Father(bob) == carol))));
+  EXPECT_TRUE(kb.Entails(*father_of_bob));
+  EXPECT_TRUE(kb.Entails(*grandfather));
+  EXPECT_FALSE(kb.Entails(*cycle));
+}
+
 }  // namespace limbo
 
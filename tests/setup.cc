@@ -2,6 +2,8 @@
 // Copyright 2014 Christoph Schwering
 
 #include <array>
+#include <functional>
+#include <set>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -76,5 +78,482 @@ TEST(SetupTest, Subsumes_Consistent_clauses) {
   }
 }
 
-}  // namespace limbo
+TEST(SetupTest, ShallowCopy_propagation) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  const Term n = tf.CreateTerm(Symbol::Factory::CreateName(1, s1));
+  const Term m = tf.CreateTerm(Symbol::Factory::CreateName(2, s1));
+  const Term a = tf.CreateTerm(Symbol::Factory::CreateFunction(1, s1, 0), {});
+  const Term b = tf.CreateTerm(Symbol::Factory::CreateFunction(2, s1, 0), {});
+  const Term c = tf.CreateTerm(Symbol::Factory::CreateFunction(5, s1, 0), {});
+  const Term d = tf.CreateTerm(Symbol::Factory::CreateFunction(6, s1, 0), {});
+
+  limbo::Setup s;
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(a,n), Literal::Eq(b,n)})), limbo::Setup::kOk);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(b,n), Literal::Eq(c,n), Literal::Eq(d,n)})), limbo::Setup::kOk);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(c,n), Literal::Eq(d,m)})), limbo::Setup::kOk);
+  s.Minimize();
+  const size_t n_clauses = dist(s.clauses());
+
+  for (int i = 0; i < 2; ++i) {
+    {
+      limbo::Setup::ShallowCopy s1 = s.shallow_copy();
+      EXPECT_EQ(s1.AddUnit(Literal::Eq(a,n)), limbo::Setup::kOk);
+      EXPECT_TRUE(s1->Determines(b) && s1->Determines(b).val == n);
+      EXPECT_FALSE(s1->Determines(c));
+      {
+        limbo::Setup::ShallowCopy s2 = s.shallow_copy();
+        EXPECT_NE(s2.AddUnit(Literal::Neq(d,n)), limbo::Setup::kInconsistent);
+        EXPECT_TRUE(s2->Determines(c) && s2->Determines(c).val == n);
+        EXPECT_TRUE(s2->Determines(d) && s2->Determines(d).val == m);
+      }
+      EXPECT_FALSE(s1->Determines(c));
+      EXPECT_FALSE(s1->Determines(d));
+      {
+        limbo::Setup::ShallowCopy s2 = s.shallow_copy();
+        EXPECT_NE(s2.AddUnit(Literal::Eq(d,m)), limbo::Setup::kInconsistent);
+        EXPECT_TRUE(s2->Determines(c) && s2->Determines(c).val == n);
+        EXPECT_EQ(s2.AddUnit(Literal::Eq(c,m)), limbo::Setup::kInconsistent);
+        EXPECT_TRUE(s2->contains_empty_clause());
+      }
+      EXPECT_FALSE(s1->contains_empty_clause());
+    }
+    EXPECT_FALSE(s.Determines(b));
+    EXPECT_FALSE(s.Determines(c));
+    EXPECT_FALSE(s.Determines(d));
+    EXPECT_EQ(dist(s.clauses()), n_clauses);
+  }
+
+  {
+    limbo::Setup::ShallowCopy s1 = s.shallow_copy();
+    EXPECT_EQ(s1.AddUnit(Literal::Neq(d,n)), limbo::Setup::kOk);
+    EXPECT_EQ(s1.AddUnit(Literal::Neq(c,n)), limbo::Setup::kOk);
+    EXPECT_TRUE(s1->Determines(b) == internal::Nothing);
+    EXPECT_EQ(s1.AddUnit(Literal::Eq(a,n)), limbo::Setup::kInconsistent);
+  }
+  EXPECT_FALSE(s.contains_empty_clause());
+}
+
+TEST(SetupTest, Units_backtracking) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  const Term n = tf.CreateTerm(Symbol::Factory::CreateName(1, s1));
+  const Term m = tf.CreateTerm(Symbol::Factory::CreateName(2, s1));
+  const Term k = tf.CreateTerm(Symbol::Factory::CreateName(3, s1));
+  const Term o = tf.CreateTerm(Symbol::Factory::CreateName(4, s1));
+  const Term a = tf.CreateTerm(Symbol::Factory::CreateFunction(1, s1, 0), {});
+  const Term b = tf.CreateTerm(Symbol::Factory::CreateFunction(2, s1, 0), {});
 
+  limbo::Setup s;
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(a,n)})), limbo::Setup::kOk);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(a,m)})), limbo::Setup::kOk);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(a,m)})), limbo::Setup::kSubsumed);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Eq(b,n)})), limbo::Setup::kOk);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(b,m)})), limbo::Setup::kSubsumed);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(b,k)})), limbo::Setup::kSubsumed);
+  s.Minimize();
+  EXPECT_EQ(dist(s.clauses()), 3);
+
+  for (int i = 0; i < 2; ++i) {
+    {
+      limbo::Setup::ShallowCopy s1 = s.shallow_copy();
+      EXPECT_EQ(s1.AddUnit(Literal::Neq(a,k)), limbo::Setup::kOk);
+      EXPECT_TRUE(s1->Subsumes(Clause({Literal::Neq(a,k)})));
+      EXPECT_FALSE(s1->Determines(a));
+      {
+        limbo::Setup::ShallowCopy s2 = s.shallow_copy();
+        EXPECT_EQ(s2.AddUnit(Literal::Eq(a,n)), limbo::Setup::kInconsistent);
+      }
+      {
+        limbo::Setup::ShallowCopy s2 = s.shallow_copy();
+        EXPECT_EQ(s2.AddUnit(Literal::Eq(a,o)), limbo::Setup::kOk);
+        EXPECT_TRUE(s2->Determines(a) && s2->Determines(a).val == o);
+        EXPECT_TRUE(s2->Subsumes(Clause({Literal::Neq(a,n)})));
+        EXPECT_EQ(s2.AddUnit(Literal::Neq(a,o)), limbo::Setup::kInconsistent);
+      }
+      EXPECT_FALSE(s1->contains_empty_clause());
+      EXPECT_FALSE(s1->Determines(a));
+      EXPECT_TRUE(s1->Subsumes(Clause({Literal::Neq(a,k)})));
+    }
+    EXPECT_FALSE(s.Subsumes(Clause({Literal::Neq(a,k)})));
+    EXPECT_TRUE(s.Subsumes(Clause({Literal::Neq(a,n)})));
+    EXPECT_TRUE(s.Subsumes(Clause({Literal::Neq(a,m), Literal::Eq(b,m)})));
+    EXPECT_TRUE(s.Subsumes(Clause({Literal::Neq(b,k)})));
+    EXPECT_FALSE(s.Subsumes(Clause({Literal::Eq(a,k)})));
+    EXPECT_TRUE(s.Determines(b) && s.Determines(b).val == n);
+  }
+}
+
+TEST(SetupTest, ShallowCopy_subsumption) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  const Term n = tf.CreateTerm(Symbol::Factory::CreateName(1, s1));
+  const Term m = tf.CreateTerm(Symbol::Factory::CreateName(2, s1));
+  const Term a = tf.CreateTerm(Symbol::Factory::CreateFunction(1, s1, 0), {});
+  const Term b = tf.CreateTerm(Symbol::Factory::CreateFunction(2, s1, 0), {});
+  const Term c = tf.CreateTerm(Symbol::Factory::CreateFunction(5, s1, 0), {});
+  const Term d = tf.CreateTerm(Symbol::Factory::CreateFunction(6, s1, 0), {});
+  const Clause bc({Literal::Eq(b,n), Literal::Eq(c,n)});
+  const Clause bcd({Literal::Eq(b,n), Literal::Eq(c,n), Literal::Eq(d,m)});
+
+  limbo::Setup s;
+  EXPECT_EQ(s.AddClause(Clause({Literal::Eq(a,n), Literal::Eq(b,n), Literal::Eq(c,n)})), limbo::Setup::kOk);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Eq(a,m), Literal::Eq(d,n)})), limbo::Setup::kOk);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Eq(c,m), Literal::Eq(d,m)})), limbo::Setup::kOk);
+  s.Minimize();
+  EXPECT_FALSE(s.Subsumes(bcd));
+
+  for (int i = 0; i < 2; ++i) {
+    {
+      limbo::Setup::ShallowCopy s1 = s.shallow_copy();
+      EXPECT_EQ(s1.AddUnit(Literal::Neq(a,n)), limbo::Setup::kOk);
+      EXPECT_TRUE(s1->Subsumes(bc));
+      EXPECT_TRUE(s1->Subsumes(bcd));
+      EXPECT_FALSE(s1->Subsumes(Clause({Literal::Eq(b,n), Literal::Eq(d,m)})));
+      {
+        limbo::Setup::ShallowCopy s2 = s.shallow_copy();
+        EXPECT_EQ(s2.AddUnit(Literal::Neq(c,m)), limbo::Setup::kOk);
+        EXPECT_TRUE(s2->Subsumes(Clause({Literal::Eq(b,n), Literal::Eq(d,m)})));
+        EXPECT_TRUE(s2->Subsumes(Clause({Literal::Eq(d,m)})));
+      }
+      EXPECT_FALSE(s1->Subsumes(Clause({Literal::Eq(b,n), Literal::Eq(d,m)})));
+    }
+    EXPECT_FALSE(s.Subsumes(bc));
+    EXPECT_FALSE(s.Subsumes(bcd));
+    EXPECT_TRUE(s.Subsumes(Clause({Literal::Eq(a,n), Literal::Eq(b,n), Literal::Eq(c,n), Literal::Eq(d,m)})));
+  }
+
+  EXPECT_EQ(s.AddClause(bc), limbo::Setup::kOk);
+  s.Minimize();
+  EXPECT_EQ(dist(s.clauses()), 3);
+  EXPECT_TRUE(s.Subsumes(bcd));
+  EXPECT_TRUE(s.Subsumes(Clause({Literal::Eq(a,m), Literal::Eq(c,m), Literal::Eq(d,n)})));
+  EXPECT_FALSE(s.Subsumes(Clause({Literal::Eq(a,n), Literal::Eq(b,n)})));
+}
+
+TEST(SetupTest, Fingerprint) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  const Term n = tf.CreateTerm(Symbol::Factory::CreateName(1, s1));
+  const Term m = tf.CreateTerm(Symbol::Factory::CreateName(2, s1));
+  const Term a = tf.CreateTerm(Symbol::Factory::CreateFunction(1, s1, 0), {});
+  const Term b = tf.CreateTerm(Symbol::Factory::CreateFunction(2, s1, 0), {});
+  const Term c = tf.CreateTerm(Symbol::Factory::CreateFunction(5, s1, 0), {});
+
+  limbo::Setup s;
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(a,n), Literal::Eq(c,m)})), limbo::Setup::kOk);
+  s.Minimize();
+  const internal::hash64_t fp = s.fingerprint();
+
+  internal::hash64_t fp1;
+  {
+    limbo::Setup::ShallowCopy s1 = s.shallow_copy();
+    EXPECT_EQ(s1.AddUnit(Literal::Eq(a,n)), limbo::Setup::kOk);
+    EXPECT_EQ(s1->fingerprint(), fp ^ limbo::Setup::Fingerprint(Literal::Eq(a,n)));
+    EXPECT_EQ(s1.AddUnit(Literal::Neq(b,m)), limbo::Setup::kOk);
+    EXPECT_TRUE(s1->Determines(c) && s1->Determines(c).val == m);
+    fp1 = s1->fingerprint();
+    EXPECT_EQ(s1.AddUnit(Literal::Eq(c,m)), limbo::Setup::kSubsumed);
+    EXPECT_EQ(s1->fingerprint(), fp1);
+  }
+  EXPECT_EQ(s.fingerprint(), fp);
+  {
+    limbo::Setup::ShallowCopy s2 = s.shallow_copy();
+    EXPECT_EQ(s2.AddUnit(Literal::Neq(b,m)), limbo::Setup::kOk);
+    EXPECT_NE(s2->fingerprint(), fp1);
+    EXPECT_NE(s2.AddUnit(Literal::Eq(a,n)), limbo::Setup::kInconsistent);
+    EXPECT_EQ(s2->fingerprint(), fp1);
+    EXPECT_TRUE(s2->Determines(c) && s2->Determines(c).val == m);
+  }
+  EXPECT_EQ(s.fingerprint(), fp);
+}
+
+TEST(SetupTest, Nogoods) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  std::vector<Term> names;
+  std::vector<Term> funcs;
+  for (int i = 1; i <= 3; ++i) {
+    names.push_back(tf.CreateTerm(Symbol::Factory::CreateName(i, s1)));
+  }
+  for (int i = 1; i <= 6; ++i) {
+    funcs.push_back(tf.CreateTerm(Symbol::Factory::CreateFunction(i, s1, 0), {}));
+  }
+  unsigned int seed = 0;
+  auto rand = [&seed](size_t n) { seed = seed * 1103515245 + 12345; return (seed / 65536) % n; };
+
+  // Splits in the same order on a setup with and one without nogood learning
+  // and checks that both agree on consistency and the determined terms.
+  std::function<void(const limbo::Setup&, const limbo::Setup&, int)> split =
+      [&](const limbo::Setup& s_learn, const limbo::Setup& s_plain, int k) {
+    for (const Term t : funcs) {
+      for (const Term n : names) {
+        limbo::Setup::ShallowCopy c_learn = s_learn.shallow_copy();
+        limbo::Setup::ShallowCopy c_plain = s_plain.shallow_copy();
+        const bool r_learn = c_learn.AddUnit(Literal::Eq(t, n)) == limbo::Setup::kInconsistent;
+        const bool r_plain = c_plain.AddUnit(Literal::Eq(t, n)) == limbo::Setup::kInconsistent;
+        EXPECT_EQ(r_learn, r_plain);
+        EXPECT_EQ(c_learn->contains_empty_clause(), c_plain->contains_empty_clause());
+        if (!r_learn && !r_plain) {
+          for (const Term u : funcs) {
+            EXPECT_EQ(c_learn->Determines(u), c_plain->Determines(u));
+          }
+          if (k > 1) {
+            split(*c_learn, *c_plain, k - 1);
+          }
+        }
+      }
+    }
+  };
+
+  size_t n_nogoods = 0;
+  for (int run = 0; run < 10; ++run) {
+    limbo::Setup s_learn;
+    limbo::Setup s_plain;
+    s_plain.set_learn_nogoods(false);
+    for (int round = 0; round < 2; ++round) {
+      for (int i = 0; i < 8; ++i) {
+        std::vector<Literal> lits;
+        const size_t n = 2 + rand(2);
+        for (size_t j = 0; j < n; ++j) {
+          const Term t = funcs[rand(funcs.size())];
+          const Term m = names[rand(names.size())];
+          lits.push_back(rand(2) == 0 ? Literal::Eq(t, m) : Literal::Neq(t, m));
+        }
+        const Clause c(lits.begin(), lits.end());
+        if (c.valid()) {
+          continue;
+        }
+        s_learn.AddClause(c);
+        s_plain.AddClause(c);
+      }
+      s_learn.Minimize();
+      s_plain.Minimize();
+      split(s_learn, s_plain, 3);
+    }
+    EXPECT_EQ(s_plain.n_nogoods(), 0u);
+    n_nogoods += s_learn.n_nogoods();
+  }
+  EXPECT_GT(n_nogoods, 0u);
+}
+
+TEST(SetupTest, Overlay) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  std::vector<Term> names;
+  std::vector<Term> funcs;
+  for (int i = 1; i <= 3; ++i) {
+    names.push_back(tf.CreateTerm(Symbol::Factory::CreateName(i, s1)));
+  }
+  for (int i = 1; i <= 6; ++i) {
+    funcs.push_back(tf.CreateTerm(Symbol::Factory::CreateFunction(i, s1, 0), {}));
+  }
+  unsigned int seed = 0;
+  auto rand = [&seed](size_t n) { seed = seed * 1103515245 + 12345; return (seed / 65536) % n; };
+  auto rand_clause = [&]() {
+    std::vector<Literal> lits;
+    const size_t n = 2 + rand(2);
+    for (size_t j = 0; j < n; ++j) {
+      const Term t = funcs[rand(funcs.size())];
+      const Term m = names[rand(names.size())];
+      lits.push_back(rand(2) == 0 ? Literal::Eq(t, m) : Literal::Neq(t, m));
+    }
+    return Clause(lits.begin(), lits.end());
+  };
+
+  // Splits in the same order on an overlay and on a deep copy and checks that
+  // both agree on consistency, the determined terms, and subsumption.
+  std::function<void(const limbo::Setup&, const limbo::Setup&, int)> split =
+      [&](const limbo::Setup& s_overlay, const limbo::Setup& s_copy, int k) {
+    for (const Term t : funcs) {
+      for (const Term n : names) {
+        limbo::Setup::ShallowCopy c_overlay = s_overlay.shallow_copy();
+        limbo::Setup::ShallowCopy c_copy = s_copy.shallow_copy();
+        EXPECT_EQ(c_overlay.AddUnit(Literal::Eq(t, n)), c_copy.AddUnit(Literal::Eq(t, n)));
+        EXPECT_EQ(c_overlay->contains_empty_clause(), c_copy->contains_empty_clause());
+        EXPECT_EQ(c_overlay->fingerprint(), c_copy->fingerprint());
+        for (const Term u : funcs) {
+          EXPECT_EQ(c_overlay->Determines(u), c_copy->Determines(u));
+        }
+        const Clause c = rand_clause();
+        if (!c.valid()) {
+          EXPECT_EQ(c_overlay->Subsumes(c), c_copy->Subsumes(c));
+          if (k == 2) {
+            EXPECT_EQ(c_overlay.AddClause(c), c_copy.AddClause(c));
+          }
+        }
+        if (k > 1 && !c_copy->contains_empty_clause()) {
+          split(*c_overlay, *c_copy, k - 1);
+        }
+      }
+    }
+  };
+
+  for (int run = 0; run < 10; ++run) {
+    limbo::Setup s;
+    for (int i = 0; i < 8; ++i) {
+      const Clause c = rand_clause();
+      if (!c.valid()) {
+        s.AddClause(c);
+      }
+    }
+    s.Minimize();
+    const size_t n_clauses = dist(s.clauses());
+    const internal::hash64_t fingerprint = s.fingerprint();
+    {
+      limbo::Setup overlay = s.Overlay();
+      limbo::Setup copy = s.Copy();
+      EXPECT_EQ(dist(overlay.clauses()), n_clauses);
+      split(overlay, copy, 3);
+    }
+    EXPECT_EQ(dist(s.clauses()), n_clauses);
+    EXPECT_EQ(s.fingerprint(), fingerprint);
+  }
+}
+
+TEST(SetupTest, Minimize_incremental) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  std::vector<Term> names;
+  std::vector<Term> funcs;
+  for (int i = 1; i <= 3; ++i) {
+    names.push_back(tf.CreateTerm(Symbol::Factory::CreateName(i, s1)));
+  }
+  for (int i = 1; i <= 5; ++i) {
+    funcs.push_back(tf.CreateTerm(Symbol::Factory::CreateFunction(i, s1, 0), {}));
+  }
+  unsigned int seed = 0;
+  auto rand = [&seed](size_t n) { seed = seed * 1103515245 + 12345; return (seed / 65536) % n; };
+
+  for (int run = 0; run < 20; ++run) {
+    limbo::Setup s_inc;
+    limbo::Setup s_all;
+    for (int i = 0; i < 12; ++i) {
+      std::vector<Literal> lits;
+      const size_t n = 1 + rand(3) + (rand(4) == 0 ? 0 : 1);
+      for (size_t j = 0; j < n; ++j) {
+        const Term t = funcs[rand(funcs.size())];
+        const Term m = names[rand(names.size())];
+        lits.push_back(rand(3) == 0 ? Literal::Eq(t, m) : Literal::Neq(t, m));
+      }
+      const Clause c(lits.begin(), lits.end());
+      if (c.valid() || s_all.contains_empty_clause()) {
+        continue;
+      }
+      s_inc.AddClause(c);
+      s_inc.Minimize();
+      s_all.AddClause(c);
+    }
+    s_all.Minimize();
+    EXPECT_EQ(s_inc.contains_empty_clause(), s_all.contains_empty_clause());
+    EXPECT_EQ(dist(s_inc.clauses()), dist(s_all.clauses()));
+    for (size_t i : s_inc.clauses()) {
+      const Clause c = s_inc.clause(i);
+      EXPECT_TRUE(std::any_of(s_all.clauses().begin(), s_all.clauses().end(),
+                              [&](size_t j) { return s_all.clause(j) == c; }));
+    }
+  }
+}
+
+TEST(SetupTest, ForEachClauseMentioning) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  std::vector<Term> names;
+  std::vector<Term> funcs;
+  for (int i = 1; i <= 3; ++i) {
+    names.push_back(tf.CreateTerm(Symbol::Factory::CreateName(i, s1)));
+  }
+  for (int i = 1; i <= 6; ++i) {
+    funcs.push_back(tf.CreateTerm(Symbol::Factory::CreateFunction(i, s1, 0), {}));
+  }
+  unsigned int seed = 0;
+  auto rand = [&seed](size_t n) { seed = seed * 1103515245 + 12345; return (seed / 65536) % n; };
+  auto check = [&funcs](const limbo::Setup& s) {
+    for (const Term t : funcs) {
+      std::set<size_t> found;
+      s.ForEachClauseMentioning(t, [&](size_t i) {
+        EXPECT_LT(i, dist(s.clauses()));
+        found.insert(i);
+      });
+      for (size_t i : s.clauses()) {
+        if (s.clause(i).MentionsLhs(t)) {
+          EXPECT_EQ(found.count(i), 1u);
+        }
+      }
+    }
+  };
+
+  for (int run = 0; run < 20; ++run) {
+    limbo::Setup s;
+    for (int i = 0; i < 12; ++i) {
+      std::vector<Literal> lits;
+      const size_t n = 1 + rand(3) + (rand(4) == 0 ? 0 : 1);
+      for (size_t j = 0; j < n; ++j) {
+        const Term t = funcs[rand(funcs.size())];
+        const Term m = names[rand(names.size())];
+        lits.push_back(rand(3) == 0 ? Literal::Eq(t, m) : Literal::Neq(t, m));
+      }
+      const Clause c(lits.begin(), lits.end());
+      if (c.valid() || s.contains_empty_clause()) {
+        continue;
+      }
+      s.AddClause(c);
+      check(s);
+    }
+    s.Minimize();
+    check(s);
+    limbo::Setup::ShallowCopy sc = s.shallow_copy();
+    sc.AddUnit(Literal::Neq(funcs[rand(funcs.size())], names[rand(names.size())]));
+    check(*sc);
+  }
+}
+
+TEST(SetupTest, ShallowCopy_AddClause) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s1 = sf.CreateSort(); RegisterSort(s1, "");
+  const Term n = tf.CreateTerm(Symbol::Factory::CreateName(1, s1));
+  const Term m = tf.CreateTerm(Symbol::Factory::CreateName(2, s1));
+  const Term a = tf.CreateTerm(Symbol::Factory::CreateFunction(1, s1, 0), {});
+  const Term b = tf.CreateTerm(Symbol::Factory::CreateFunction(2, s1, 0), {});
+  const Term c = tf.CreateTerm(Symbol::Factory::CreateFunction(5, s1, 0), {});
+
+  limbo::Setup s;
+  EXPECT_EQ(s.AddClause(Clause({Literal::Neq(a,n), Literal::Eq(c,m)})), limbo::Setup::kOk);
+  EXPECT_EQ(s.AddClause(Clause({Literal::Eq(b,n)})), limbo::Setup::kOk);
+  s.Minimize();
+  const size_t n_clauses = dist(s.clauses());
+
+  {
+    limbo::Setup::ShallowCopy s1 = s.shallow_copy();
+    EXPECT_EQ(s1.AddClause(Clause({Literal::Eq(b,n), Literal::Eq(c,n)})), limbo::Setup::kSubsumed);
+    EXPECT_EQ(s1.AddClause(Clause({Literal::Neq(b,n), Literal::Eq(a,n)})), limbo::Setup::kOk);
+    EXPECT_TRUE(s1->Determines(a) && s1->Determines(a).val == n);
+    EXPECT_TRUE(s1->Determines(c) && s1->Determines(c).val == m);
+    {
+      limbo::Setup::ShallowCopy s2 = s.shallow_copy();
+      EXPECT_EQ(s2.AddUnit(Literal::Eq(c,n)), limbo::Setup::kInconsistent);
+    }
+    EXPECT_EQ(s.n_nogoods(), 0);
+  }
+  EXPECT_FALSE(s.Determines(a));
+  EXPECT_FALSE(s.Determines(c));
+  EXPECT_EQ(dist(s.clauses()), n_clauses);
+  EXPECT_FALSE(s.Subsumes(Clause({Literal::Eq(a,n)})));
+  {
+    limbo::Setup::ShallowCopy s1 = s.shallow_copy();
+    EXPECT_EQ(s1.AddUnit(Literal::Eq(a,n)), limbo::Setup::kOk);
+    EXPECT_EQ(s1.AddUnit(Literal::Eq(c,n)), limbo::Setup::kInconsistent);
+  }
+  EXPECT_GT(s.n_nogoods(), 0);
+}
+
+}  // namespace limbo
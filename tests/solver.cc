@@ -240,5 +240,332 @@ TEST(SolverTest, Constants) {
   }
 }
 
-}  // namespace limbo
+TEST(SolverTest, NogoodsConsistent) {
+  Context ctx;
+  Solver& warm = *ctx.solver();
+  Solver fresh(ctx.sf(), ctx.tf());
+  auto Val = ctx.CreateSort();             RegisterSort(Val, "");
+  std::vector<HiTerm> n;
+  std::vector<HiTerm> f;
+  for (int i = 0; i < 3; ++i) {
+    n.push_back(ctx.CreateName(Val));
+  }
+  for (int i = 0; i < 5; ++i) {
+    f.push_back(ctx.CreateFunction(Val, 0)());
+  }
+  auto add = [&](const Clause& c) { warm.AddClause(c); fresh.AddClause(c); };
+  add(( f[1] != n[2] || f[3] == n[0] || f[3] == n[1] ).as_clause());
+  add(( f[0] == n[0] || f[1] == n[2] || f[3] != n[0] ).as_clause());
+  add(( f[2] == n[2] || f[3] == n[0] ).as_clause());
+  add(( f[1] != n[0] || f[1] == n[2] || f[2] == n[0] ).as_clause());
+  add(( f[4] == n[2] ).as_clause());
+  add(( f[0] != n[0] ).as_clause());
+  add(( f[3] != n[0] || f[3] == n[2] || f[4] != n[0] ).as_clause());
+  auto phi = (~(f[0] == n[1] || f[1] != n[2]))->NF(ctx.sf(), ctx.tf());
+  EXPECT_TRUE(fresh.Consistent(1, *phi, Solver::kConsistencyGuarantee));
+  // Nogoods learned by earlier queries must not affect Consistent().
+  for (int k = 0; k <= 1; ++k) {
+    for (const HiTerm t : f) {
+      warm.Determines(k, t, Solver::kConsistencyGuarantee);
+      warm.Determines(k, t, Solver::kNoConsistencyGuarantee);
+      for (const HiTerm m : n) {
+        warm.Entails(k, *(t == m)->NF(ctx.sf(), ctx.tf()), Solver::kConsistencyGuarantee);
+        warm.Entails(k, *(t != m)->NF(ctx.sf(), ctx.tf()), Solver::kNoConsistencyGuarantee);
+        warm.Consistent(k, *(t == m)->NF(ctx.sf(), ctx.tf()), Solver::kConsistencyGuarantee);
+      }
+    }
+  }
+  EXPECT_TRUE(warm.Consistent(1, *phi, Solver::kConsistencyGuarantee));
+  EXPECT_EQ(warm.Consistent(1, *phi, Solver::kConsistencyGuarantee),
+            fresh.Consistent(1, *phi, Solver::kConsistencyGuarantee));
+}
+
+// A 3x3 Latin square: each cell[i][j] is one of ns[0], ns[1], ns[2], and no
+// value occurs twice in a row or column. The clauses are passed to add.
+struct LatinSquare {
+  Symbol::Sort sort;
+  std::vector<HiTerm> ns;
+  std::vector<std::vector<HiTerm>> cell;
+};
+
+template<typename AddClause>
+LatinSquare AddLatinSquare(Context* ctx, AddClause add) {
+  LatinSquare sq;
+  auto Val = ctx->CreateSort();             RegisterSort(Val, "");
+  auto x = ctx->CreateVariable(Val);        REGISTER_SYMBOL(x);
+  sq.sort = Val;
+  sq.cell.resize(3);
+  for (int i = 0; i < 3; ++i) {
+    sq.ns.push_back(ctx->CreateName(Val));
+    for (int j = 0; j < 3; ++j) {
+      sq.cell[i].push_back(ctx->CreateFunction(Val, 0)());
+    }
+  }
+  const std::vector<HiTerm>& ns = sq.ns;
+  const std::vector<std::vector<HiTerm>>& cell = sq.cell;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      for (int k = j + 1; k < 3; ++k) {
+        add(( cell[i][j] != x || cell[i][k] != x ).as_clause());
+        add(( cell[j][i] != x || cell[k][i] != x ).as_clause());
+      }
+      add(( cell[i][0] == ns[j] || cell[i][1] == ns[j] || cell[i][2] == ns[j] ).as_clause());
+      add(( cell[0][i] == ns[j] || cell[1][i] == ns[j] || cell[2][i] == ns[j] ).as_clause());
+    }
+  }
+  return sq;
+}
+
+// Expects that both solvers give the same answers to all queries about the
+// cells of the Latin square up to split level max_k.
+inline void ExpectSameResults(Context* ctx, const LatinSquare& sq, int max_k, Solver* s1, Solver* s2) {
+  for (int k = 0; k <= max_k; ++k) {
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        const Term t = sq.cell[i][j];
+        EXPECT_EQ(s1->Determines(k, t, Solver::kConsistencyGuarantee),
+                  s2->Determines(k, t, Solver::kConsistencyGuarantee));
+        EXPECT_EQ(s1->Determines(k, t, Solver::kNoConsistencyGuarantee),
+                  s2->Determines(k, t, Solver::kNoConsistencyGuarantee));
+        for (const HiTerm n : sq.ns) {
+          Formula::Ref phi = (sq.cell[i][j] == n)->NF(ctx->sf(), ctx->tf());
+          EXPECT_EQ(s1->Entails(k, *phi, Solver::kConsistencyGuarantee),
+                    s2->Entails(k, *phi, Solver::kConsistencyGuarantee));
+          EXPECT_EQ(s1->Entails(k, *phi, Solver::kNoConsistencyGuarantee),
+                    s2->Entails(k, *phi, Solver::kNoConsistencyGuarantee));
+          EXPECT_EQ(s1->Consistent(k, *phi, Solver::kConsistencyGuarantee),
+                    s2->Consistent(k, *phi, Solver::kConsistencyGuarantee));
+          EXPECT_EQ(s1->EntailsComplete(k, *phi, Solver::kConsistencyGuarantee),
+                    s2->EntailsComplete(k, *phi, Solver::kConsistencyGuarantee));
+        }
+      }
+    }
+  }
+}
 
+TEST(SolverTest, ParallelSplit) {
+  Context ctx;
+  Solver& seq = *ctx.solver();
+  Solver par(ctx.sf(), ctx.tf());
+  par.set_threads(4);
+  auto add = [&](const Clause& c) { seq.AddClause(c); par.AddClause(c); };
+  const LatinSquare sq = AddLatinSquare(&ctx, add);
+  add(( sq.cell[0][0] == sq.ns[0] ).as_clause());
+  add(( sq.cell[1][1] == sq.ns[1] ).as_clause());
+  ExpectSameResults(&ctx, sq, 3, &seq, &par);
+  const internal::Maybe<Term> r = par.Determines(2, sq.cell[2][2], Solver::kConsistencyGuarantee);
+  EXPECT_TRUE(r && r.val == sq.ns[2]);
+}
+
+TEST(SolverTest, TranspositionTable) {
+  Context ctx;
+  Solver& tt = *ctx.solver();
+  Solver no_tt(ctx.sf(), ctx.tf());
+  no_tt.set_transposition_table_size(0);
+  auto add = [&](const Clause& c) { tt.AddClause(c); no_tt.AddClause(c); };
+  const LatinSquare sq = AddLatinSquare(&ctx, add);
+  add(( sq.cell[0][0] == sq.ns[0] ).as_clause());
+  ExpectSameResults(&ctx, sq, 3, &tt, &no_tt);
+  EXPECT_GT(tt.transposition_table_hits(), 0u);
+  EXPECT_EQ(no_tt.transposition_table_hits() + no_tt.transposition_table_misses(), 0u);
+}
+
+TEST(SolverTest, LazyGrounding) {
+  {
+    Context ctx;
+    Solver& eager = *ctx.solver();
+    Solver lazy(ctx.sf(), ctx.tf());
+    lazy.set_lazy_grounding(true);
+    auto add = [&](const Clause& c) { eager.AddClause(c); lazy.AddClause(c); };
+    const LatinSquare sq = AddLatinSquare(&ctx, add);
+    add(( sq.cell[0][0] == sq.ns[0] ).as_clause());
+    add(( sq.cell[1][1] == sq.ns[1] ).as_clause());
+    ExpectSameResults(&ctx, sq, 2, &eager, &lazy);
+  }
+
+  {
+    Context ctx;
+    Solver& solver = *ctx.solver();
+    solver.set_lazy_grounding(true);
+    auto Bool = ctx.CreateSort();                RegisterSort(Bool, "");
+    auto True = ctx.CreateName(Bool);            REGISTER_SYMBOL(True);
+    auto Human = ctx.CreateSort();               RegisterSort(Human, "");
+    auto Sonny = ctx.CreateName(Human);          REGISTER_SYMBOL(Sonny);
+    auto Mary = ctx.CreateName(Human);           REGISTER_SYMBOL(Mary);
+    auto Fred = ctx.CreateName(Human);           REGISTER_SYMBOL(Fred);
+    auto Father = ctx.CreateFunction(Human, 1);       REGISTER_SYMBOL(Father);
+    auto Mother = ctx.CreateFunction(Human, 1);       REGISTER_SYMBOL(Mother);
+    auto IsParentOf = ctx.CreateFunction(Bool, 2);    REGISTER_SYMBOL(IsParentOf);
+    auto IsChildOf = ctx.CreateFunction(Bool, 2);     REGISTER_SYMBOL(IsChildOf);
+    auto x = ctx.CreateVariable(Human);               REGISTER_SYMBOL(x);
+    auto y = ctx.CreateVariable(Human);               REGISTER_SYMBOL(y);
+    auto z = ctx.CreateVariable(Human);               REGISTER_SYMBOL(z);
+    auto w = ctx.CreateVariable(Human);               REGISTER_SYMBOL(w);
+    solver.AddClause(( Father(x) != y || x == y || IsParentOf(y,x) == True ).as_clause());
+    solver.AddClause(( Father(Sonny) == Mary || Father(Sonny) == Fred ).as_clause());
+    solver.AddClause(( Mother(x) != y || x == y || IsChildOf(x,y) == True ).as_clause());
+    auto phi = Ex(x, Ex(y, IsParentOf(y,x) == True))->NF(ctx.sf(), ctx.tf());
+    EXPECT_FALSE(solver.Entails(0, *phi, Solver::kConsistencyGuarantee));
+    EXPECT_TRUE(solver.Entails(1, *phi, Solver::kConsistencyGuarantee));
+    auto psi = Ex(x, Ex(y, Ex(z, Ex(w, IsParentOf(y,x) == True || IsParentOf(w,z) == True))))->NF(ctx.sf(), ctx.tf());
+    EXPECT_TRUE(solver.Entails(1, *psi, Solver::kConsistencyGuarantee));
+    // Mother and IsChildOf are unrelated to the queries
+    for (size_t i : solver.setup().clauses()) {
+      EXPECT_FALSE(solver.setup().clause(i).any([&](Literal a) { return a.lhs().symbol() == Mother; }));
+    }
+  }
+}
+
+TEST(SolverTest, QueryCache) {
+  Context ctx;
+  Solver& cache = *ctx.solver();
+  Solver no_cache(ctx.sf(), ctx.tf());
+  cache.set_query_cache_size(64);
+  auto add = [&](const Clause& c) { cache.AddClause(c); no_cache.AddClause(c); };
+  const LatinSquare sq = AddLatinSquare(&ctx, add);
+  const std::vector<HiTerm>& ns = sq.ns;
+  const std::vector<std::vector<HiTerm>>& cell = sq.cell;
+  add(( cell[0][0] == ns[0] ).as_clause());
+  ExpectSameResults(&ctx, sq, 2, &cache, &no_cache);
+  const size_t misses = cache.query_cache_misses();
+  EXPECT_GT(misses, 0u);
+  ExpectSameResults(&ctx, sq, 2, &cache, &no_cache);
+  EXPECT_GT(cache.query_cache_hits(), 0u);
+  EXPECT_EQ(no_cache.query_cache_hits() + no_cache.query_cache_misses(), 0u);
+
+  // Alpha-equivalent formulas share an entry.
+  auto x = ctx.CreateVariable(sq.sort);    REGISTER_SYMBOL(x);
+  auto y = ctx.CreateVariable(sq.sort);    REGISTER_SYMBOL(y);
+  auto phi = Ex(x, cell[0][1] == x && x != ns[0])->NF(ctx.sf(), ctx.tf());
+  auto psi = Ex(y, cell[0][1] == y && y != ns[0])->NF(ctx.sf(), ctx.tf());
+  EXPECT_TRUE(cache.Entails(1, *phi, Solver::kConsistencyGuarantee));
+  const size_t hits = cache.query_cache_hits();
+  EXPECT_TRUE(cache.Entails(1, *psi, Solver::kConsistencyGuarantee));
+  EXPECT_EQ(cache.query_cache_hits(), hits + 1);
+
+  // New clauses invalidate the cache.
+  EXPECT_FALSE(cache.Entails(0, *(cell[1][1] == ns[1])->NF(ctx.sf(), ctx.tf()), Solver::kConsistencyGuarantee));
+  add(( cell[1][1] == ns[1] ).as_clause());
+  EXPECT_TRUE(cache.Entails(0, *(cell[1][1] == ns[1])->NF(ctx.sf(), ctx.tf()), Solver::kConsistencyGuarantee));
+  ExpectSameResults(&ctx, sq, 2, &cache, &no_cache);
+
+  // A small cache evicts entries, but the results do not change.
+  cache.set_query_cache_size(4);
+  ExpectSameResults(&ctx, sq, 2, &cache, &no_cache);
+}
+
+TEST(SolverTest, QueryCacheLazyGrounding) {
+  Context ctx;
+  Solver& solver = *ctx.solver();
+  solver.set_lazy_grounding(true);
+  solver.set_query_cache_size(64);
+  auto Bool = ctx.CreateSort();                RegisterSort(Bool, "");
+  auto True = ctx.CreateName(Bool);            REGISTER_SYMBOL(True);
+  auto Human = ctx.CreateSort();               RegisterSort(Human, "");
+  auto Sonny = ctx.CreateName(Human);          REGISTER_SYMBOL(Sonny);
+  auto P = ctx.CreateFunction(Bool, 0)();      REGISTER_SYMBOL(P);
+  auto Q = ctx.CreateFunction(Bool, 1);        REGISTER_SYMBOL(Q);
+  auto R = ctx.CreateFunction(Human, 0)();     REGISTER_SYMBOL(R);
+  auto x = ctx.CreateVariable(Human);          REGISTER_SYMBOL(x);
+  solver.AddClause(( R == Sonny ).as_clause());
+  solver.AddClause(( Q(x) == True ).as_clause());
+  solver.AddClause(( Q(x) != True ).as_clause());
+  auto phi = (P == True)->NF(ctx.sf(), ctx.tf());
+  auto psi = (Q(Sonny) == True)->NF(ctx.sf(), ctx.tf());
+  // Q(x) is not grounded yet, so the setup is consistent so far.
+  EXPECT_FALSE(solver.Entails(0, *phi, Solver::kNoConsistencyGuarantee));
+  EXPECT_TRUE(solver.Consistent(1, *phi, Solver::kNoConsistencyGuarantee));
+  EXPECT_FALSE(solver.Entails(0, *phi, Solver::kNoConsistencyGuarantee));
+  EXPECT_TRUE(solver.Consistent(1, *phi, Solver::kNoConsistencyGuarantee));
+  // Grounding Q makes the setup inconsistent, which invalidates the cache.
+  EXPECT_TRUE(solver.Entails(0, *psi, Solver::kNoConsistencyGuarantee));
+  EXPECT_TRUE(solver.Entails(0, *phi, Solver::kNoConsistencyGuarantee));
+  EXPECT_FALSE(solver.Consistent(1, *phi, Solver::kNoConsistencyGuarantee));
+}
+
+TEST(SolverTest, Batch) {
+  Context ctx;
+  Solver& solver = *ctx.solver();
+  const LatinSquare sq = AddLatinSquare(&ctx, [&](const Clause& c) { solver.AddClause(c); });
+  const std::vector<HiTerm>& ns = sq.ns;
+  const std::vector<std::vector<HiTerm>>& cell = sq.cell;
+  solver.AddClause(( cell[0][0] == ns[0] ).as_clause());
+  solver.AddClause(( cell[1][1] == ns[1] ).as_clause());
+  auto x = ctx.CreateVariable(sq.sort);    REGISTER_SYMBOL(x);
+  std::vector<Term> terms;
+  std::vector<Formula::Ref> phis;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      terms.push_back(cell[i][j]);
+      for (const HiTerm n : ns) {
+        phis.push_back((cell[i][j] == n)->NF(ctx.sf(), ctx.tf()));
+      }
+    }
+  }
+  phis.push_back(Fa(x, cell[2][2] != x || cell[0][0] != x)->NF(ctx.sf(), ctx.tf()));
+  phis.push_back(Ex(x, cell[2][2] == x && cell[0][0] != x)->NF(ctx.sf(), ctx.tf()));
+  for (int k = 0; k <= 2; ++k) {
+    for (bool assume_consistent : {Solver::kConsistencyGuarantee, Solver::kNoConsistencyGuarantee}) {
+      const std::vector<internal::Maybe<Term>> rs = solver.DeterminesAll(k, terms, assume_consistent);
+      ASSERT_EQ(rs.size(), terms.size());
+      for (size_t i = 0; i < terms.size(); ++i) {
+        EXPECT_EQ(rs[i], solver.Determines(k, terms[i], assume_consistent));
+      }
+      const std::vector<bool> qs = solver.EntailsAll(k, phis, assume_consistent);
+      ASSERT_EQ(qs.size(), phis.size());
+      for (size_t i = 0; i < phis.size(); ++i) {
+        EXPECT_EQ(qs[i], solver.Entails(k, *phis[i], assume_consistent));
+      }
+    }
+  }
+  const std::vector<internal::Maybe<Term>> rs = solver.DeterminesAll(1, terms, Solver::kConsistencyGuarantee);
+  for (size_t i = 0; i < terms.size(); ++i) {
+    EXPECT_TRUE(rs[i]);
+  }
+  EXPECT_TRUE(rs[8] && rs[8].val == ns[2]);
+}
+
+TEST(SolverTest, Deepening) {
+  Context ctx;
+  Solver& solver = *ctx.solver();
+  const LatinSquare sq = AddLatinSquare(&ctx, [&](const Clause& c) { solver.AddClause(c); });
+  const std::vector<HiTerm>& ns = sq.ns;
+  const std::vector<std::vector<HiTerm>>& cell = sq.cell;
+  solver.AddClause(( cell[0][0] == ns[0] ).as_clause());
+  solver.AddClause(( cell[1][1] == ns[1] ).as_clause());
+  const int max_k = 3;
+  {
+    int k = 0;
+    auto phi = (cell[2][2] == ns[2])->NF(ctx.sf(), ctx.tf());
+    EXPECT_FALSE(solver.EntailsUpTo(max_k, *phi, Solver::kConsistencyGuarantee, &k, Solver::Clock::now()));
+    EXPECT_EQ(k, -1);
+    EXPECT_TRUE(solver.EntailsUpTo(max_k, *phi, Solver::kConsistencyGuarantee, &k));
+    EXPECT_TRUE(solver.Entails(k, *phi, Solver::kConsistencyGuarantee));
+  }
+  for (bool assume_consistent : {Solver::kConsistencyGuarantee, Solver::kNoConsistencyGuarantee}) {
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        int k = -1;
+        internal::Maybe<Term> r = solver.DeterminesUpTo(max_k, cell[i][j], assume_consistent, &k);
+        int l = 0;
+        while (l < max_k && !solver.Determines(l, cell[i][j], assume_consistent)) {
+          ++l;
+        }
+        EXPECT_EQ(r, solver.Determines(l, cell[i][j], assume_consistent));
+        EXPECT_EQ(k, l);
+        for (const HiTerm n : ns) {
+          auto phi = (cell[i][j] == n && cell[2][2] == ns[2])->NF(ctx.sf(), ctx.tf());
+          const bool q = solver.EntailsUpTo(max_k, *phi, assume_consistent, &k);
+          l = 0;
+          while (l < max_k && !solver.Entails(l, *phi, assume_consistent)) {
+            ++l;
+          }
+          EXPECT_EQ(q, solver.Entails(l, *phi, assume_consistent));
+          EXPECT_EQ(k, l);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace limbo
@@ -3,6 +3,9 @@
 
 #include <gtest/gtest.h>
 
+#include <functional>
+#include <thread>
+
 #include <limbo/term.h>
 #include <limbo/format/output.h>
 
@@ -82,6 +85,146 @@ TEST(TermTest, general) {
   EXPECT_TRUE(sorts == std::set<Symbol::Sort>({s1,s2}));
 }
 
+TEST(TermTest, Factory) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s = sf.CreateSort();
+  const Symbol f = sf.CreateFunction(s, 2);
+  const Symbol g = sf.CreateFunction(s, 3);
+  std::vector<Term> ns;
+  for (int i = 0; i < 100; ++i) {
+    ns.push_back(tf.CreateTerm(sf.CreateName(s)));
+  }
+  // enough terms to fill several chunks of the arena and to grow the hash table
+  std::vector<Term> ts;
+  for (int i = 0; i < 100; ++i) {
+    for (int j = 0; j < 100; ++j) {
+      ts.push_back(tf.CreateTerm(f, {ns[i], ns[j]}));
+      ts.push_back(tf.CreateTerm(g, {ns[j], ns[i], ts.back()}));
+    }
+  }
+  EXPECT_EQ(std::unordered_set<Term>(ts.begin(), ts.end()).size(), ts.size());
+  for (int i = 0; i < 100; ++i) {
+    for (int j = 0; j < 100; ++j) {
+      const Term t1 = ts[2 * (100 * i + j)];
+      const Term t2 = ts[2 * (100 * i + j) + 1];
+      EXPECT_EQ(t1, tf.CreateTerm(f, {ns[i], ns[j]}));
+      EXPECT_EQ(t2, tf.CreateTerm(g, {ns[j], ns[i], t1}));
+      EXPECT_TRUE(t1.symbol() == f && t1.arity() == 2 && t1.arg(0) == ns[i] && t1.arg(1) == ns[j]);
+      EXPECT_EQ(std::vector<Term>(t2.args().begin(), t2.args().end()), std::vector<Term>({ns[j], ns[i], t1}));
+    }
+  }
+}
+
+TEST(TermTest, Factory_concurrent) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s = sf.CreateSort();
+  const Symbol f = sf.CreateFunction(s, 2);
+  const Symbol g = sf.CreateFunction(s, 2);
+  const int kThreads = 4;
+  const int kNames = 60;
+  std::vector<Term> ns;
+  for (int i = 0; i < kNames; ++i) {
+    ns.push_back(tf.CreateTerm(sf.CreateName(s)));
+  }
+  // every thread creates new names and the same terms, each in a different order
+  std::vector<std::vector<Term>> new_names(kThreads);
+  std::vector<std::vector<Term>> terms(kThreads, std::vector<Term>(2 * kNames * kNames));
+  std::vector<std::thread> threads;
+  for (int k = 0; k < kThreads; ++k) {
+    threads.emplace_back([&, k]() {
+      for (int i = 0; i < 100; ++i) {
+        new_names[k].push_back(tf.CreateTerm(sf.CreateName(s)));
+      }
+      for (int m = 0; m < kNames * kNames; ++m) {
+        const int l = (k % 2 == 0 ? m : kNames * kNames - 1 - m);
+        const int i = (l / kNames + k) % kNames;
+        const int j = l % kNames;
+        const Term t = tf.CreateTerm(f, {ns[i], ns[j]});
+        terms[k][2 * (kNames * i + j)] = t;
+        terms[k][2 * (kNames * i + j) + 1] = tf.CreateTerm(g, {t, ns[i]});
+      }
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  std::unordered_set<Term> all_new_names;
+  for (int k = 0; k < kThreads; ++k) {
+    all_new_names.insert(new_names[k].begin(), new_names[k].end());
+    EXPECT_EQ(terms[k], terms[0]);
+  }
+  EXPECT_EQ(all_new_names.size(), kThreads * 100);
+  EXPECT_EQ(std::unordered_set<Term>(terms[0].begin(), terms[0].end()).size(), terms[0].size());
+  for (int i = 0; i < kNames; ++i) {
+    for (int j = 0; j < kNames; ++j) {
+      const Term t1 = terms[0][2 * (kNames * i + j)];
+      const Term t2 = terms[0][2 * (kNames * i + j) + 1];
+      EXPECT_TRUE(t1.symbol() == f && t1.arg(0) == ns[i] && t1.arg(1) == ns[j]);
+      EXPECT_TRUE(t2.symbol() == g && t2.arg(0) == t1 && t2.arg(1) == ns[i]);
+      EXPECT_EQ(t2, tf.CreateTerm(g, {tf.CreateTerm(f, {ns[i], ns[j]}), ns[i]}));
+    }
+  }
+}
+
+TEST(TermTest, Flags) {
+  Symbol::Factory& sf = *Symbol::Factory::Instance();
+  Term::Factory& tf = *Term::Factory::Instance();
+  const Symbol::Sort s = sf.CreateSort();
+
+  // The recursive definitions of the cached flags.
+  std::function<bool(Term)> ground = [&ground](Term t) {
+    return t.name() || (t.function() && std::all_of(t.args().begin(), t.args().end(), ground));
+  };
+  auto primitive = [](Term t) {
+    return t.function() && std::all_of(t.args().begin(), t.args().end(), [](Term t) { return t.name(); });
+  };
+  auto quasiprimitive = [](Term t) {
+    return t.function() &&
+        std::all_of(t.args().begin(), t.args().end(), [](Term t) { return t.name() || t.variable(); });
+  };
+
+  const Term n = tf.CreateTerm(sf.CreateName(s));
+  const Term x = tf.CreateTerm(sf.CreateVariable(s));
+  const Term c = tf.CreateTerm(sf.CreateFunction(s, 0), {});
+  const Symbol f = sf.CreateFunction(s, 1);
+  const Symbol g = sf.CreateFunction(s, 2);
+  std::vector<Term> ts = {n, x, c};
+  for (int depth = 0; depth < 2; ++depth) {
+    const std::vector<Term> us = ts;
+    for (const Term t1 : us) {
+      ts.push_back(tf.CreateTerm(f, {t1}));
+      for (const Term t2 : us) {
+        ts.push_back(tf.CreateTerm(g, {t1, t2}));
+      }
+    }
+  }
+  // Terms created by substitution must have the same flags.
+  const std::vector<Term> us = ts;
+  for (const Term t : us) {
+    ts.push_back(t.Substitute(EqSubstitute(x, n), &tf));
+    ts.push_back(t.Substitute(EqSubstitute(n, x), &tf));
+    ts.push_back(t.Substitute(EqSubstitute(c, x), &tf));
+  }
+  size_t n_ground = 0;
+  size_t n_primitive = 0;
+  size_t n_quasiprimitive = 0;
+  for (const Term t : ts) {
+    EXPECT_EQ(t.ground(), ground(t));
+    EXPECT_EQ(t.primitive(), primitive(t));
+    EXPECT_EQ(t.quasiprimitive(), quasiprimitive(t));
+    n_ground += t.ground() ? 1 : 0;
+    n_primitive += t.primitive() ? 1 : 0;
+    n_quasiprimitive += t.quasiprimitive() ? 1 : 0;
+  }
+  EXPECT_GT(n_ground, 0u);
+  EXPECT_LT(n_ground, ts.size());
+  EXPECT_GT(n_primitive, 0u);
+  EXPECT_GT(n_quasiprimitive, n_primitive);
+  EXPECT_LT(n_quasiprimitive, ts.size());
+}
+
 TEST(TermTest, Unify) {
   Symbol::Factory& sf = *Symbol::Factory::Instance();
   Term::Factory& tf = *Term::Factory::Instance();
@@ -0,0 +1,44 @@
+// vim:filetype=cpp:textwidth=120:shiftwidth=2:softtabstop=2:expandtab
+// Copyright 2017 Christoph Schwering
+
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <limbo/internal/threadpool.h>
+
+namespace limbo {
+namespace internal {
+
+TEST(ThreadPoolTest, general) {
+  for (size_t n_workers : {0, 1, 3}) {
+    ThreadPool pool(n_workers);
+    EXPECT_EQ(pool.size(), n_workers);
+    for (int round = 0; round < 10; ++round) {
+      const size_t n_tasks = 100 * round;
+      std::vector<int> done(n_tasks, 0);
+      std::vector<size_t> per_thread(pool.size() + 1, 0);
+      std::atomic<size_t> n_done(0);
+      pool.Run(n_tasks, [&](size_t i, size_t thread) {
+        EXPECT_LE(thread, pool.size());
+        ++done[i];
+        ++per_thread[thread];
+        ++n_done;
+      });
+      EXPECT_EQ(n_done, n_tasks);
+      for (size_t i = 0; i < n_tasks; ++i) {
+        EXPECT_EQ(done[i], 1);
+      }
+      size_t sum = 0;
+      for (size_t n : per_thread) {
+        sum += n;
+      }
+      EXPECT_EQ(sum, n_tasks);
+    }
+  }
+}
+
+}  // namespace internal
+}  // namespace limbo
+